@@ -0,0 +1,16 @@
+#ifndef __MMAN_H__
+#define __MMAN_H__
+
+#include <sys/types.h>
+
+/* The subset of <sys/mman.h> supported by the kernel: read-only mappings of files. */
+
+#define PROT_READ   0x1
+#define MAP_SHARED  0x1
+#define MAP_PRIVATE 0x2
+
+#define MAP_FAILED ((void *)-1)
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+
+#endif
@@ -1,27 +1,46 @@
 #include "common.h"
 #include <sys/syscall.h>
 #include <sys/stat.h>
+#include "mman.h"
+
+/* an artificial system call of the kernel */
+#define SYS_has_sysenter 1000
+
+/* Whether the kernel has set up ``sysenter'', which is much cheaper than
+ * ``int $0x80''. The kernel is asked at the first system call.
+ */
+static int has_sysenter = -1;
 
 int __attribute__((__noinline__))
 syscall(int id, ...) {
 	int ret;
 	int *args = &id;
-	asm volatile("int $0x80": "=a"(ret) : "a"(args[0]), "b"(args[1]), "c"(args[2]), "d"(args[3]));
+
+	if(has_sysenter < 0) {
+		asm volatile("int $0x80" : "=a"(has_sysenter) : "a"(SYS_has_sysenter));
+	}
+
+	if(has_sysenter) {
+		/* The stack is passed in %ebp and the return address in %esi. */
+		asm volatile("pushl %%ebp; movl %%esp, %%ebp; movl $1f, %%esi; sysenter; 1: popl %%ebp"
+				: "=a"(ret) : "a"(args[0]), "b"(args[1]), "c"(args[2]), "d"(args[3]) : "esi", "memory");
+	}
+	else {
+		asm volatile("int $0x80": "=a"(ret) : "a"(args[0]), "b"(args[1]), "c"(args[2]), "d"(args[3]));
+	}
 	return ret;
 }
 
 void _exit(int status) {
-	nemu_assert(!status);
+	syscall(SYS_exit, status);
 }
 
 int open(const char *pathname, int flags) {
-	nemu_assert(0);
-	return 0; 
+	return syscall(SYS_open, pathname, flags); 
 }
 
 int read(int fd, char *buf, int len) {
-	nemu_assert(0);
-	return 0; 
+	return syscall(SYS_read, fd, buf, len); 
 }
 
 int write(int fd, char *buf, int len) {
@@ -29,8 +48,7 @@ int write(int fd, char *buf, int len) {
 }
 
 off_t lseek(int fd, off_t offset, int whence) {
-	nemu_assert(0);
-	return 0; 
+	return syscall(SYS_lseek, fd, offset, whence); 
 }
 
 void *sbrk(int incr) {
@@ -48,9 +66,13 @@ void *sbrk(int incr) {
 	return prev_heap_end;
 }
 
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset) {
+	uint32_t args[6] = { (uint32_t)addr, len, prot, flags, fd, offset };
+	return (void *)syscall(SYS_mmap, args);
+}
+
 int close(int fd) {
-	nemu_assert(0);
-	return 0; 
+	return syscall(SYS_close, fd); 
 }
 
 int fstat(int fd, struct stat *buf) {
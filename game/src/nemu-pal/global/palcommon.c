@@ -22,6 +22,7 @@
 //
 
 #include "palcommon.h"
+#include "mman.h"
 
 INT
 PAL_RLEBlitToSurface(
@@ -649,6 +650,113 @@ PAL_SpriteGetFrame(
    return &lpSprite[offset];
 }
 
+//
+// MKF archives mapped into memory with mmap(), so that chunks are accessed
+// in place instead of being copied with fseek() + fread(). The archives stay
+// open during the whole game, so the mappings are never released.
+//
+#define PAL_MAX_MKF_MAPPING     32
+
+static struct
+{
+   FILE          *fp;
+   LPCBYTE        lpBase;       // NULL if the file can not be mapped
+   UINT           uiSize;
+} g_MKFMapping[PAL_MAX_MKF_MAPPING];
+
+static LPCBYTE
+PAL_MKFGetMapping(
+   FILE           *fp,
+   UINT           *puiSize
+)
+/*++
+  Purpose:
+
+    Get the memory mapping of an MKF archive. The archive is mapped at the
+    first call.
+
+  Parameters:
+
+    [IN]  fp - pointer to the fopen'ed MKF file.
+
+    [OUT] puiSize - size of the file.
+
+  Return value:
+
+    Pointer to the content of the file, or NULL if it can not be mapped.
+
+--*/
+{
+   int            i;
+   void          *p;
+
+   for (i = 0; i < PAL_MAX_MKF_MAPPING && g_MKFMapping[i].fp != NULL; i++)
+   {
+      if (g_MKFMapping[i].fp == fp)
+      {
+         *puiSize = g_MKFMapping[i].uiSize;
+         return g_MKFMapping[i].lpBase;
+      }
+   }
+
+   if (i == PAL_MAX_MKF_MAPPING)
+   {
+      return NULL;
+   }
+
+   fseek(fp, 0, SEEK_END);
+   g_MKFMapping[i].fp = fp;
+   g_MKFMapping[i].uiSize = ftell(fp);
+
+   p = mmap(NULL, g_MKFMapping[i].uiSize, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+   g_MKFMapping[i].lpBase = (p == MAP_FAILED ? NULL : (LPCBYTE)p);
+
+   *puiSize = g_MKFMapping[i].uiSize;
+   return g_MKFMapping[i].lpBase;
+}
+
+static VOID
+PAL_MKFRead(
+   LPVOID          lpBuffer,
+   UINT            uiOffset,
+   UINT            uiLen,
+   FILE           *fp
+)
+/*++
+  Purpose:
+
+    Read uiLen bytes at uiOffset of an MKF archive into lpBuffer.
+
+  Parameters:
+
+    [OUT] lpBuffer - pointer to the destination buffer.
+
+    [IN]  uiOffset - offset in the file.
+
+    [IN]  uiLen - number of bytes to read.
+
+    [IN]  fp - pointer to the fopen'ed MKF file.
+
+  Return value:
+
+    None.
+
+--*/
+{
+   UINT           uiSize;
+   LPCBYTE        lpBase = PAL_MKFGetMapping(fp, &uiSize);
+
+   if (lpBase != NULL && uiOffset <= uiSize && uiLen <= uiSize - uiOffset)
+   {
+      memcpy(lpBuffer, lpBase + uiOffset, uiLen);
+   }
+   else
+   {
+      fseek(fp, uiOffset, SEEK_SET);
+      fread(lpBuffer, uiLen, 1, fp);
+   }
+}
+
 INT
 PAL_MKFGetChunkCount(
    FILE *fp
@@ -674,8 +782,7 @@ PAL_MKFGetChunkCount(
       return 0;
    }
 
-   fseek(fp, 0, SEEK_SET);
-   fread(&iNumChunk, sizeof(INT), 1, fp);
+   PAL_MKFRead(&iNumChunk, 0, sizeof(INT), fp);
 
    iNumChunk = (SWAP32(iNumChunk) - 4) / 4;
    return iNumChunk;
@@ -720,9 +827,8 @@ PAL_MKFGetChunkSize(
    //
    // Get the offset of the specified chunk and the next chunk.
    //
-   fseek(fp, 4 * uiChunkNum, SEEK_SET);
-   fread(&uiOffset, sizeof(UINT), 1, fp);
-   fread(&uiNextOffset, sizeof(UINT), 1, fp);
+   PAL_MKFRead(&uiOffset, 4 * uiChunkNum, sizeof(UINT), fp);
+   PAL_MKFRead(&uiNextOffset, 4 * uiChunkNum + 4, sizeof(UINT), fp);
    uiOffset = SWAP32(uiOffset);
    uiNextOffset = SWAP32(uiNextOffset);
 
@@ -784,9 +890,8 @@ PAL_MKFReadChunk(
    //
    // Get the offset of the chunk.
    //
-   fseek(fp, 4 * uiChunkNum, SEEK_SET);
-   fread(&uiOffset, 4, 1, fp);
-   fread(&uiNextOffset, 4, 1, fp);
+   PAL_MKFRead(&uiOffset, 4 * uiChunkNum, 4, fp);
+   PAL_MKFRead(&uiNextOffset, 4 * uiChunkNum + 4, 4, fp);
    uiOffset = SWAP32(uiOffset);
    uiNextOffset = SWAP32(uiNextOffset);
 
@@ -802,8 +907,7 @@ PAL_MKFReadChunk(
 
    if (uiChunkLen != 0)
    {
-      fseek(fp, uiOffset, SEEK_SET);
-      fread(lpBuffer, uiChunkLen, 1, fp);
+      PAL_MKFRead(lpBuffer, uiOffset, uiChunkLen, fp);
    }
    else
    {
@@ -857,21 +961,19 @@ PAL_MKFGetDecompressedSize(
    //
    // Get the offset of the chunk.
    //
-   fseek(fp, 4 * uiChunkNum, SEEK_SET);
-   fread(&uiOffset, 4, 1, fp);
+   PAL_MKFRead(&uiOffset, 4 * uiChunkNum, 4, fp);
    uiOffset = SWAP32(uiOffset);
 
    //
    // Read the header.
    //
-   fseek(fp, uiOffset, SEEK_SET);
 #ifdef PAL_WIN95
-   fread(buf, sizeof(DWORD), 1, fp);
+   PAL_MKFRead(buf, uiOffset, sizeof(DWORD), fp);
    buf[0] = SWAP32(buf[0]);
 
    return (INT)buf[0];
 #else
-   fread(buf, sizeof(DWORD), 2, fp);
+   PAL_MKFRead(buf, uiOffset, sizeof(DWORD) * 2, fp);
    buf[0] = SWAP32(buf[0]);
    buf[1] = SWAP32(buf[1]);
 
@@ -910,6 +1012,8 @@ PAL_MKFDecompressChunk(
 --*/
 {
    LPBYTE          buf;
+   LPCBYTE         lpBase;
+   UINT            uiSize, uiOffset;
    int             len;
 
    len = PAL_MKFGetChunkSize(uiChunkNum, fp);
@@ -919,6 +1023,20 @@ PAL_MKFDecompressChunk(
       return len;
    }
 
+   //
+   // Decompress the chunk in place if the archive is mapped.
+   //
+   lpBase = PAL_MKFGetMapping(fp, &uiSize);
+   if (lpBase != NULL)
+   {
+      PAL_MKFRead(&uiOffset, 4 * uiChunkNum, 4, fp);
+      uiOffset = SWAP32(uiOffset);
+      if (uiOffset <= uiSize && (UINT)len <= uiSize - uiOffset)
+      {
+         return Decompress(lpBase + uiOffset, lpBuffer, uiBufferSize);
+      }
+   }
+
    buf = (LPBYTE)malloc(len);
    if (buf == NULL)
    {
@@ -3,14 +3,16 @@
 
 #include "common.h"
 
-/* TODO: The decleration order of the members in the ``TrapFrame''
- * structure below is wrong. Please re-orgainize it for the C
- * code to use the trap frame correctly.
+/* The trap frame built by the CPU and ``asm_do_irq'' in ``do_irq.S'',
+ * from the lowest address: the registers saved by ``pushal'', the irq
+ * number and the error code pushed by the entry code, and finally
+ * %eip, %cs and %eflags pushed by the CPU.
  */
 
 typedef struct TrapFrame {
-	uint32_t esi, ebx, eax, eip, edx, error_code, eflags, ecx, cs, old_esp, edi, ebp;
+	uint32_t edi, esi, ebp, old_esp, ebx, edx, ecx, eax;
 	int32_t irq;
+	uint32_t error_code, eip, cs, eflags;
 } TrapFrame;
 
 #endif
@@ -18,6 +18,9 @@
 /* NEMU has 128MB physical memory  */
 #define PHY_MEM   (128 * 1024 * 1024)
 
+/* the largest block of the buddy allocator is 2^MAX_ORDER pages (4MB) */
+#define MAX_ORDER 10
+
 #define make_invalid_pde() 0
 #define make_invalid_pte() 0
 #define make_pde(addr) ((((uint32_t)(addr)) & 0xfffff000) | 0x7)
@@ -0,0 +1,31 @@
+#ifndef __PROC_H__
+#define __PROC_H__
+
+#include "common.h"
+#include "irq.h"
+
+/* The processes are all in ring 0 and run on their own stacks, which are
+ * at the same virtual address in different address spaces. A process is
+ * only switched when the kernel returns to user code, so the kernel itself
+ * is never preempted.
+ */
+
+#define NR_PROC 8
+
+enum { PROC_UNUSED, PROC_READY, PROC_WAITING, PROC_ZOMBIE };
+
+typedef struct PCB {
+	int state;
+	int pid;
+	int parent;				/* the slot of the parent, or -1 for the kernel */
+	TrapFrame *tf;			/* where the process is resumed, in its address space */
+	int exit_status;
+
+	int wait_pid;			/* the child waited for, or -1 for any child */
+	uint32_t wait_status;	/* where to store the exit status of the child */
+} PCB;
+
+/* the slot of the running process in the per-process tables */
+int proc_slot();
+
+#endif
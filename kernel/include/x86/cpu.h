@@ -18,6 +18,28 @@ write_cr0(uint32_t cr0) {
 	asm volatile("movl %0, %%cr0" : : "r"(cr0));
 }
 
+/* read CR2, the address which causes the last page fault */
+static inline uint32_t
+read_cr2() {
+	uint32_t val;
+	asm volatile("movl %%cr2, %0" : "=r"(val));
+	return val;
+}
+
+/* read CR4 */
+static inline uint32_t
+read_cr4() {
+	uint32_t val;
+	asm volatile("movl %%cr4, %0" : "=r"(val));
+	return val;
+}
+
+/* write CR4 */
+static inline void
+write_cr4(uint32_t cr4) {
+	asm volatile("movl %0, %%cr4" : : "r"(cr4));
+}
+
 /* write CR3, notice that CR3 is never read */
 static inline void
 write_cr3(uint32_t cr3) {
@@ -62,6 +84,38 @@ wait_intr() {
 	asm volatile("hlt");
 }
 
+/* read the time stamp counter, which counts instructions in NEMU */
+static inline uint64_t
+rdtsc(void) {
+	uint64_t val;
+	asm volatile("rdtsc" : "=A"(val));
+	return val;
+}
+
+/* performance counters of NEMU, used as the index of rdpmc() */
+#define PMC_INSTR     0
+#define PMC_MEM_READ  1
+#define PMC_MEM_WRITE 2
+#define PMC_BRANCH    3
+#define PMC_TLB_MISS  4
+
+static inline uint64_t
+rdpmc(uint32_t idx) {
+	uint64_t val;
+	asm volatile("rdpmc" : "=A"(val) : "c"(idx));
+	return val;
+}
+
+/* MSRs of the fast system call, see ``sysenter_entry'' in do_irq.S */
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+static inline void
+wrmsr(uint32_t idx, uint64_t val) {
+	asm volatile("wrmsr" : : "c"(idx), "A"(val));
+}
+
 #define NR_IRQ    256
 
 #endif
@@ -27,4 +27,16 @@ out_long(uint16_t port, uint32_t data) {
 	asm volatile("out %%eax, %%dx" : : "a"(data), "d"(port));
 }
 
+/* read `cnt' longs from `port' into `addr' */
+static inline void
+ins_long(uint16_t port, void *addr, uint32_t cnt) {
+	asm volatile("cld; rep insl" : "+D"(addr), "+c"(cnt) : "d"(port) : "memory");
+}
+
+/* write `cnt' longs from `addr' to `port' */
+static inline void
+outs_long(uint16_t port, const void *addr, uint32_t cnt) {
+	asm volatile("cld; rep outsl" : "+S"(addr), "+c"(cnt) : "d"(port) : "memory");
+}
+
 #endif
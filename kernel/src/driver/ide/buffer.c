@@ -1,68 +1,318 @@
 #include "common.h"
-#define NR_SEC_BUF    128   /* sector buffer is a direct address hash */
+#include "memory.h"
 
-void disk_do_read(void *, uint32_t);
-void disk_do_write(void *, uint32_t);
+#include <string.h>
+
+/* The sector buffer is a NR_WAY-way set-associative cache with LRU
+ * replacement. A sector is placed in set (sector % NR_SET).
+ *
+ * A miss which continues the previous miss (i.e. the reader is streaming
+ * through the disk) reads ahead a window of sectors with one multi-sector
+ * command, and the window doubles with every such miss up to RA_MAX.
+ * Dirty sectors are written back together with their dirty neighbours,
+ * also with one multi-sector command. Besides eviction, they are written
+ * back a few at a time by the writeback daemon in ide.c.
+ *
+ * Aligned requests of at least BYPASS_MIN whole sectors do not go through
+ * the buffer, and the disk transfers the data directly into (or out of)
+ * the caller's buffer.
+ */
+#define NR_WAY    4
+#define NR_SET    64
+#define RA_MIN    4
+#define RA_MAX    32   /* not larger than NR_SET, so a window never meets itself in a set */
+#define WB_MAX    32
+#define BYPASS_MIN 16
+
+void disk_do_read(void *, uint32_t, uint32_t);
+void disk_do_write(void *, uint32_t, uint32_t);
+void *mm_user_ptr(int, uint32_t);
+int proc_slot();
 
 struct SectorBuf {
 	uint32_t sector;
 	bool used, dirty;
+	uint32_t last_use;
 	uint8_t content[512];
 };
-static struct SectorBuf buf[NR_SEC_BUF];
+static struct SectorBuf buf[NR_SET][NR_WAY];
+static uint32_t lru_clock;
+
+/* the sector where a streaming reader is expected to miss next,
+ * and the size of the next read-ahead window */
+static uint32_t ra_next, ra_size;
+
+static uint8_t ra_buf[RA_MAX * 512];
+static uint8_t wb_buf[WB_MAX * 512];
+
+/* where the current pass of writeback continues */
+static uint32_t wb_cursor;
 
 void
 buf_init(void) {
+	int i, j;
+	for (i = 0; i < NR_SET; i ++) {
+		for (j = 0; j < NR_WAY; j ++) {
+			buf[i][j].used = false;
+			buf[i][j].dirty = false;
+		}
+	}
+	lru_clock = 0;
+	ra_next = -1;
+	ra_size = 1;
+	wb_cursor = 0;
+}
+
+static struct SectorBuf *
+buf_lookup(uint32_t sector) {
+	struct SectorBuf *set = buf[sector % NR_SET];
 	int i;
-	for (i = 0; i < NR_SEC_BUF; i ++) {
-		buf[i].used = false;
+	for (i = 0; i < NR_WAY; i ++) {
+		if (set[i].used && set[i].sector == sector) {
+			return &set[i];
+		}
 	}
+	return NULL;
 }
 
-void
-buf_writeback(void) {
+/* Write back the run of dirty sectors starting at `start', at most `max'
+ * of them, in one command. Return the number of sectors written.
+ */
+static uint32_t
+buf_writeback_from(uint32_t start, uint32_t max) {
+	struct SectorBuf *p;
+	uint32_t n;
+	if (max > WB_MAX) { max = WB_MAX; }
+	for (n = 0; n < max; n ++) {
+		p = buf_lookup(start + n);
+		if (p == NULL || !p->dirty) {
+			break;
+		}
+		memcpy(wb_buf + (n << 9), p->content, 512);
+		p->dirty = false;
+	}
+	disk_do_write(wb_buf, start, n);
+	return n;
+}
+
+/* Write back the dirty sector `ptr' along with the dirty sectors
+ * adjacent to it, in one command.
+ */
+static void
+buf_writeback_run(struct SectorBuf *ptr) {
+	uint32_t start = ptr->sector;
+	struct SectorBuf *p;
+	while (start > 0 && ptr->sector - start < WB_MAX - 1 &&
+			(p = buf_lookup(start - 1)) != NULL && p->dirty) {
+		start --;
+	}
+	buf_writeback_from(start, WB_MAX);
+}
+
+/* Write back at most `budget' dirty sectors. A pass of writeback goes
+ * through the dirty sectors in ascending order, like an elevator, and
+ * every call continues the pass from where the last one stopped. Return
+ * whether the pass is not finished yet.
+ */
+bool
+buf_writeback_some(uint32_t budget) {
+	while (budget > 0) {
+		/* the lowest dirty sector not below the cursor */
+		struct SectorBuf *next = NULL;
+		int i, j;
+		for (i = 0; i < NR_SET; i ++) {
+			for (j = 0; j < NR_WAY; j ++) {
+				struct SectorBuf *p = &buf[i][j];
+				if (p->dirty && p->sector >= wb_cursor && (next == NULL || p->sector < next->sector)) {
+					next = p;
+				}
+			}
+		}
+		if (next == NULL) {
+			wb_cursor = 0;
+			return false;
+		}
+
+		uint32_t n = buf_writeback_from(next->sector, budget);
+		wb_cursor = next->sector + n;
+		budget -= n;
+	}
+	return true;
+}
+
+/* Find a way for `sector' in its set, evicting the least recently used one. */
+static struct SectorBuf *
+buf_alloc(uint32_t sector) {
+	struct SectorBuf *set = buf[sector % NR_SET], *victim = &set[0];
 	int i;
-	for (i = 0; i < NR_SEC_BUF; i ++) {
-		if (buf[i].dirty == true) {
-			disk_do_write(&buf[i].content, buf[i].sector);
-			buf[i].dirty = false;
+	for (i = 0; i < NR_WAY; i ++) {
+		if (!set[i].used) {
+			victim = &set[i];
+			break;
 		}
+		if (set[i].last_use < victim->last_use) {
+			victim = &set[i];
+		}
+	}
+
+	if (victim->used && victim->dirty) {
+		buf_writeback_run(victim);
 	}
+	victim->used = true;
+	victim->dirty = false;
+	victim->sector = sector;
+	return victim;
 }
 
 static struct SectorBuf *
 buf_fetch(uint32_t sector) {
-	struct SectorBuf *ptr = &buf[sector % NR_SEC_BUF];
-	
-	if (ptr->used == true && ptr->sector == sector) {
-		/* buf hit, do nothing */
-	} else {
-		if (ptr->used == true && ptr->dirty == true) {
-			/* write back */
-			disk_do_write(&ptr->content, ptr->sector);
+	struct SectorBuf *ptr = buf_lookup(sector);
+
+	if (ptr == NULL) {
+		/* grow the read-ahead window if the reader is streaming */
+		if (sector == ra_next) {
+			ra_size = (ra_size < RA_MIN ? RA_MIN : ra_size * 2);
+			if (ra_size > RA_MAX) { ra_size = RA_MAX; }
+		} else {
+			ra_size = 1;
+		}
+
+		/* do not read again what is already in the buffer, it may be dirty */
+		uint32_t n;
+		for (n = 1; n < ra_size; n ++) {
+			if (buf_lookup(sector + n) != NULL) {
+				break;
+			}
 		}
+
 		/* issue a read command */
-		disk_do_read(&ptr->content, sector);
+		disk_do_read(ra_buf, sector, n);
+		ra_next = sector + n;
 
-		ptr->used = true;
-		ptr->sector = sector;
-		ptr->dirty = false;
+		uint32_t i;
+		for (i = n - 1; i > 0; i --) {
+			struct SectorBuf *p = buf_alloc(sector + i);
+			memcpy(p->content, ra_buf + (i << 9), 512);
+			p->last_use = lru_clock ++;
+		}
+		ptr = buf_alloc(sector);
+		memcpy(ptr->content, ra_buf, 512);
 	}
+
+	ptr->last_use = lru_clock ++;
 	return ptr;
 }
 
-uint8_t
-read_byte(uint32_t offset) {
-	uint32_t sector = offset >> 9;
-	struct SectorBuf *ptr = buf_fetch(sector);
-	return ptr->content[offset & 511];
+/* Write back the dirty sectors in [sector, sector + nr_sector). */
+static void
+buf_flush(uint32_t sector, uint32_t nr_sector) {
+	uint32_t i;
+	for (i = 0; i < nr_sector; i ++) {
+		struct SectorBuf *p = buf_lookup(sector + i);
+		if (p != NULL && p->dirty) {
+			buf_writeback_run(p);
+		}
+	}
+}
+
+/* Drop the sectors in [sector, sector + nr_sector) from the buffer. */
+static void
+buf_invalidate(uint32_t sector, uint32_t nr_sector) {
+	uint32_t i;
+	for (i = 0; i < nr_sector; i ++) {
+		struct SectorBuf *p = buf_lookup(sector + i);
+		if (p != NULL) {
+			p->used = false;
+			p->dirty = false;
+		}
+	}
+}
+
+/* The number of whole sectors which can be transferred between the disk
+ * and `ptr' directly, or 0 if the request should go through the buffer.
+ * The disk only sees physical addresses, so the transfer must be in the
+ * kernel mapping, where va_to_pa() works. `*kptr' is set to the kernel
+ * address of `ptr'. A user buffer is translated through the page
+ * directory of the current process, and the transfer stops at the end
+ * of its physically contiguous run.
+ */
+static uint32_t
+bypass_sectors(uint8_t **kptr, uint8_t *ptr, uint32_t offset, uint32_t len) {
+	if ((offset & 511) != 0 || len < (BYPASS_MIN << 9)) {
+		return 0;
+	}
+	uint32_t n = len >> 9;
+	if (n > 256) { n = 256; }
+
+	if (KOFFSET == 0 || (uint32_t)ptr >= KOFFSET) {
+		*kptr = ptr;
+		return n;
+	}
+
+#ifdef IA32_PAGE
+	/* the pages are already populated by the caller */
+	uint8_t *k = mm_user_ptr(proc_slot(), (uint32_t)ptr);
+	if (k == NULL) {
+		return 0;
+	}
+	uint32_t run = PAGE_SIZE - ((uint32_t)ptr & (PAGE_SIZE - 1));
+	while (run < (n << 9) && mm_user_ptr(proc_slot(), (uint32_t)ptr + run) == k + run) {
+		run += PAGE_SIZE;
+	}
+	if (run < (n << 9)) { n = run >> 9; }
+	*kptr = k;
+	return n;
+#else
+	return 0;
+#endif
 }
 
 void
-write_byte(uint32_t offset, uint8_t data) {
-	uint32_t sector = offset >> 9;
-	struct SectorBuf *ptr = buf_fetch(sector);
-	ptr->content[offset & 511] = data;
-	ptr->dirty = true;
+buf_read(uint8_t *dst, uint32_t offset, uint32_t len) {
+	while (len > 0) {
+		uint32_t sector = offset >> 9;
+		uint8_t *k;
+		uint32_t n = bypass_sectors(&k, dst, offset, len);
+		if (n > 0) {
+			/* the disk must not return older data than the buffer */
+			buf_flush(sector, n);
+			disk_do_read(k, sector, n);
+			ra_next = sector + n;
+			n <<= 9;
+		}
+		else {
+			struct SectorBuf *ptr = buf_fetch(sector);
+			n = 512 - (offset & 511);
+			if (n > len) { n = len; }
+			memcpy(dst, ptr->content + (offset & 511), n);
+		}
+		dst += n;
+		offset += n;
+		len -= n;
+	}
 }
 
+void
+buf_write(uint8_t *src, uint32_t offset, uint32_t len) {
+	while (len > 0) {
+		uint32_t sector = offset >> 9;
+		uint8_t *k;
+		uint32_t n = bypass_sectors(&k, src, offset, len);
+		if (n > 0) {
+			/* the copies in the buffer are overwritten */
+			buf_invalidate(sector, n);
+			disk_do_write(k, sector, n);
+			n <<= 9;
+		}
+		else {
+			struct SectorBuf *ptr = buf_fetch(sector);
+			n = 512 - (offset & 511);
+			if (n > len) { n = len; }
+			memcpy(ptr->content + (offset & 511), src, n);
+			ptr->dirty = true;
+		}
+		src += n;
+		offset += n;
+		len -= n;
+	}
+}
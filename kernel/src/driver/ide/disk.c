@@ -3,10 +3,22 @@
 
 //#define USE_DMA_READ
 
+/* Write the sectors by DMA, so that the disk does the copy in the
+ * background while the CPU waits for the interrupt. */
+#define USE_DMA_WRITE
+
+/* Use the paravirtual block device in NEMU instead of the IDE registers.
+ * A sector then costs one doorbell write instead of hundreds of port I/Os. */
+#define USE_PVBLK
+
 #define IDE_PORT_BASE   0x1F0
 
-void dma_prepare(void *);
+void dma_prepare(void *, uint32_t);
 void dma_issue_read(void);
+void dma_issue_write(void);
+
+void pvblk_read(void *, uint32_t, uint32_t);
+void pvblk_write(void *, uint32_t, uint32_t);
 
 void clear_ide_intr(void);
 void wait_ide_intr(void);
@@ -16,16 +28,12 @@ static void waitdisk() {
 }
 
 static void
-ide_prepare(uint32_t sector) {
+ide_prepare(uint32_t sector, uint32_t nr_sector, bool dma) {
 	waitdisk();
 
-#ifdef USE_DMA_READ
-	out_byte(IDE_PORT_BASE + 1, 1);
-#else
-	out_byte(IDE_PORT_BASE + 1, 0);
-#endif
+	out_byte(IDE_PORT_BASE + 1, dma ? 1 : 0);
 
-	out_byte(IDE_PORT_BASE + 2, 1);
+	out_byte(IDE_PORT_BASE + 2, nr_sector & 0xFF);	/* 0 means 256 */
 	out_byte(IDE_PORT_BASE + 3, sector & 0xFF);
 	out_byte(IDE_PORT_BASE + 4, (sector >> 8) & 0xFF);
 	out_byte(IDE_PORT_BASE + 5, (sector >> 16) & 0xFF);
@@ -44,39 +52,54 @@ issue_read() {
 
 static inline void
 issue_write() {
+#ifdef USE_DMA_WRITE
+	out_byte(IDE_PORT_BASE + 7, 0xca);
+	dma_issue_write();
+#else
 	out_byte(IDE_PORT_BASE + 7, 0x30);
+#endif
 }
 
+/* Transfer `nr_sector' (at most 256) consecutive sectors with one command. */
 void
-disk_do_read(void *buf, uint32_t sector) {
-#ifdef USE_DMA_READ
-	dma_prepare(buf);
-
-	clear_ide_intr();
+disk_do_read(void *buf, uint32_t sector, uint32_t nr_sector) {
+	assert(nr_sector > 0 && nr_sector <= 256);
+#ifdef USE_PVBLK
+	pvblk_read(buf, sector, nr_sector);
+	return;
 #endif
 
-	ide_prepare(sector);
-	issue_read();
-
 #ifdef USE_DMA_READ
+	dma_prepare(buf, nr_sector);
+	clear_ide_intr();
+	ide_prepare(sector, nr_sector, true);
+	issue_read();
 	wait_ide_intr();
 #else
-	int i;
-	for (i = 0; i < 512 / sizeof(uint32_t); i ++) {
-		*(((uint32_t*)buf) + i) = in_long(IDE_PORT_BASE);
-	}
+	ide_prepare(sector, nr_sector, false);
+	issue_read();
+	ins_long(IDE_PORT_BASE, buf, nr_sector * (512 / sizeof(uint32_t)));
 #endif
-
 }
 
 void
-disk_do_write(void *buf, uint32_t sector) {
-	int i;
+disk_do_write(void *buf, uint32_t sector, uint32_t nr_sector) {
+	assert(nr_sector > 0 && nr_sector <= 256);
+#ifdef USE_PVBLK
+	pvblk_write(buf, sector, nr_sector);
+	return;
+#endif
 
-	ide_prepare(sector);
+#ifdef USE_DMA_WRITE
+	dma_prepare(buf, nr_sector);
+	clear_ide_intr();
+	ide_prepare(sector, nr_sector, true);
+	issue_write();
+	wait_ide_intr();
+#else
+	ide_prepare(sector, nr_sector, false);
 	issue_write();
 
-	for (i = 0; i < 512 / sizeof(uint32_t); i ++) {
-		out_long(IDE_PORT_BASE, *(((uint32_t*)buf) + i));
-	}
+	outs_long(IDE_PORT_BASE, buf, nr_sector * (512 / sizeof(uint32_t)));
+#endif
 }
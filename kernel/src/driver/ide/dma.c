@@ -4,32 +4,51 @@
 
 #define BMR_PORT 0xc040
 
-/* TODO: define the PRDT here */
+/* A PRD entry describes at most 64KB, so a command of 256 sectors takes
+ * two entries. */
+#define NR_PRD 2
+#define PRD_MAX (64 * 1024)
 
+typedef struct {
+	uint32_t addr;
+	uint16_t byte_cnt;		/* 0 means 64KB */
+	uint16_t reserved : 15;
+	uint16_t eot : 1;
+} PRD;
 
+static PRD prdt[NR_PRD] __attribute__((aligned(8)));
 
+/* Describe `nr_sector' sectors at `buf' in the PRDT. The buffer must be
+ * in the kernel mapping, where it is also physically contiguous.
+ *
+ * NOTE: All addresses seen by devices are physical.
+ */
 void
-dma_prepare(void *buf) {
-	/* TODO:
-	 * 1. Prepare a Physical Region Descriptor Table(PRDT)
-	 *		with single entry.
-	 * 2. Fill the PRD entry as following
-	 *		address: the address of ``buf''
-	 *		byte_cnt: 512
-	 *		eot: 1
-	 * 3. Load the address of PRDT to the Descriptor Table
-	 *		Pointer Register(port = BMR_PORT + 4):
-	 *
-	 *			out_long(BMR_PORT + 4, PRDT_addr);
-	 * 
-	 *
-	 * NOTE: All addresses seen by devices are physical.
-	 */
-
-	panic("please implement me");
+dma_prepare(void *buf, uint32_t nr_sector) {
+	uint32_t len = nr_sector << 9;
+	uint8_t *p = buf;
+	int i;
+	for (i = 0; len > 0; i ++) {
+		assert(i < NR_PRD);
+		uint32_t n = (len > PRD_MAX ? PRD_MAX : len);
+		prdt[i].addr = (uint32_t)va_to_pa(p);
+		prdt[i].byte_cnt = n & 0xffff;
+		prdt[i].reserved = 0;
+		prdt[i].eot = 0;
+		p += n;
+		len -= n;
+	}
+	prdt[i - 1].eot = 1;
+
+	out_long(BMR_PORT + 4, (uint32_t)va_to_pa(prdt));
 }
 
 void
 dma_issue_read(void) {
 	out_byte(BMR_PORT, in_byte(BMR_PORT) | 0x1 | 0x8);
 }
+
+void
+dma_issue_write(void) {
+	out_byte(BMR_PORT, (in_byte(BMR_PORT) & ~0x8) | 0x1);
+}
@@ -3,6 +3,6 @@
 
 #define BMR_PORT 0xc040
 
-void dma_prepare(void *);
+void dma_prepare(void *, uint32_t);
 
 #endif
@@ -1,41 +1,73 @@
 #include "common.h"
+#include "x86.h"
 
 #define WRITEBACK_TIME  1  /* writeback buf for every 1 second */
+#define WRITEBACK_RATE  64 /* at most 64 sectors are written back in a tick */
 #define HZ 100
 
 void buf_init(void);
-void buf_writeback(void);
-uint8_t read_byte(uint32_t);
-void write_byte(uint32_t, uint8_t);
+bool buf_writeback_some(uint32_t);
+void buf_read(uint8_t *, uint32_t, uint32_t);
+void buf_write(uint8_t *, uint32_t, uint32_t);
 
 void add_irq_handle(int, void (*)(void));
+void add_deferred_handle(void (*)(void));
+void init_pvblk(void);
+
+/* whether the buffer is being used, when the writeback daemon must wait */
+static volatile bool ide_busy = false;
 
 /* The kernel is monolithic, therefore we do not need to
  * translate the address ``buf'' from the user process to
  * a physical one, which is necessary for a microkernel.
  */
 void ide_read(uint8_t *buf, uint32_t offset, uint32_t len) {
-	uint32_t i;
-	for (i = 0; i < len; i ++) {
-		buf[i] = read_byte(offset + i);
-	}
+	ide_busy = true;
+	buf_read(buf, offset, len);
+	ide_busy = false;
 }
 
 void ide_write(uint8_t *buf, uint32_t offset, uint32_t len) {
-	uint32_t i;
-	for (i = 0; i < len; i ++) {
-		write_byte(offset + i, buf[i]);
-	}
+	ide_busy = true;
+	buf_write(buf, offset, len);
+	ide_busy = false;
 }
 
+/* The timer only starts a pass of writeback and hands out the budget of
+ * this tick. The dirty sectors are written by the daemon below, which
+ * runs after the interrupt with interrupts enabled, so a large flush
+ * neither stalls other interrupts nor the program for long.
+ */
+static volatile uint32_t wb_budget = 0;
+static bool wb_active = false;
+
 static void
 ide_writeback(void) {
 	static uint32_t counter = 0;
 	counter ++;
 	if (counter == WRITEBACK_TIME * HZ) {
-		buf_writeback();
+		wb_active = true;
 		counter = 0;
 	}
+	if (wb_active) {
+		wb_budget = WRITEBACK_RATE;
+	}
+}
+
+static void
+ide_writeback_daemon(void) {
+	if (wb_budget == 0 || ide_busy) {
+		return;
+	}
+
+	cli();
+	uint32_t budget = wb_budget;
+	wb_budget = 0;
+	ide_busy = true;
+	sti();
+
+	wb_active = buf_writeback_some(budget);
+	ide_busy = false;
 }
 
 static volatile int has_ide_intr;
@@ -62,7 +94,9 @@ wait_ide_intr(void) {
 void
 init_ide(void) {
 	buf_init();
+	init_pvblk();
 	add_irq_handle(0, ide_writeback);
+	add_deferred_handle(ide_writeback_daemon);
 	add_irq_handle(14, ide_intr);
 }
 
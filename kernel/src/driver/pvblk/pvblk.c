@@ -0,0 +1,160 @@
+#include "common.h"
+#include "memory.h"
+#include "x86.h"
+
+/* Driver of the paravirtual block device in NEMU. Requests are described
+ * in a queue in memory, and the device is notified by a single write to
+ * the doorbell port for a whole batch of requests, instead of issuing
+ * several port I/O instructions for every sector.
+ */
+
+#define PVBLK_PORT 0xc080
+#define PVBLK_IRQ 15
+
+#define PVBLK_QUEUE_SIZE 64
+
+#define PVBLK_DESC_NEXT  0x1
+#define PVBLK_DESC_WRITE 0x2
+
+#define PVBLK_T_IN  0
+#define PVBLK_T_OUT 1
+
+#define PVBLK_S_OK 0
+
+/* the largest buffer described by one descriptor */
+#define PVBLK_SEG_SIZE (64 * 1024)
+/* data descriptors in one request, besides the header and the status */
+#define PVBLK_REQ_SEG 8
+#define PVBLK_REQ_DESC (PVBLK_REQ_SEG + 2)
+#define PVBLK_NR_REQ (PVBLK_QUEUE_SIZE / PVBLK_REQ_DESC)
+
+typedef struct {
+	uint32_t addr;
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+} pvblk_desc;
+
+typedef struct {
+	uint32_t type;
+	uint32_t sector;
+} pvblk_req_hdr;
+
+typedef struct {
+	pvblk_desc desc[PVBLK_QUEUE_SIZE];
+	struct {
+		uint16_t flags;
+		uint16_t idx;
+		uint16_t ring[PVBLK_QUEUE_SIZE];
+	} avail;
+	struct {
+		uint16_t flags;
+		volatile uint16_t idx;
+		struct {
+			uint32_t id;
+			uint32_t len;
+		} ring[PVBLK_QUEUE_SIZE];
+	} used;
+} pvblk_queue;
+
+static pvblk_queue queue;
+static pvblk_req_hdr hdr[PVBLK_NR_REQ];
+static volatile uint8_t status[PVBLK_NR_REQ];
+
+void add_irq_handle(int, void (*)(void));
+
+static void
+pvblk_intr(void) {
+	/* Nothing to do. The driver checks the used ring by itself. */
+}
+
+/* Queue a request for at most `len' bytes starting at `sector', using the
+ * descriptors of request slot `req'. Return the number of bytes queued.
+ */
+static uint32_t
+pvblk_add_req(int req, int type, uint8_t *buf, uint32_t sector, uint32_t len) {
+	uint16_t d = req * PVBLK_REQ_DESC;
+	uint16_t head = d;
+
+	hdr[req].type = type;
+	hdr[req].sector = sector;
+	status[req] = 0xff;
+
+	queue.desc[d].addr = (uint32_t)va_to_pa(&hdr[req]);
+	queue.desc[d].len = sizeof(pvblk_req_hdr);
+	queue.desc[d].flags = PVBLK_DESC_NEXT;
+	queue.desc[d].next = d + 1;
+	d ++;
+
+	uint32_t total = 0;
+	int i;
+	for (i = 0; i < PVBLK_REQ_SEG && total < len; i ++) {
+		uint32_t n = len - total;
+		if (n > PVBLK_SEG_SIZE) { n = PVBLK_SEG_SIZE; }
+		queue.desc[d].addr = (uint32_t)va_to_pa(buf + total);
+		queue.desc[d].len = n;
+		queue.desc[d].flags = PVBLK_DESC_NEXT | (type == PVBLK_T_IN ? PVBLK_DESC_WRITE : 0);
+		queue.desc[d].next = d + 1;
+		total += n;
+		d ++;
+	}
+
+	queue.desc[d].addr = (uint32_t)va_to_pa(&status[req]);
+	queue.desc[d].len = 1;
+	queue.desc[d].flags = PVBLK_DESC_WRITE;
+	queue.desc[d].next = 0;
+
+	queue.avail.ring[queue.avail.idx % PVBLK_QUEUE_SIZE] = head;
+	queue.avail.idx ++;
+	return total;
+}
+
+/* Transfer `nr_sector' sectors between `buf' and the disk. The transfer is
+ * split into as many requests as the queue can hold, and the device is
+ * notified once for every batch.
+ */
+static void
+pvblk_rw(int type, void *buf, uint32_t sector, uint32_t nr_sector) {
+	uint8_t *p = buf;
+	uint32_t len = nr_sector << 9;
+
+	while (len > 0) {
+		int nr_req = 0;
+		while (nr_req < PVBLK_NR_REQ && len > 0) {
+			uint32_t n = pvblk_add_req(nr_req, type, p, sector, len);
+			p += n;
+			sector += n >> 9;
+			len -= n;
+			nr_req ++;
+		}
+
+		/* make sure the device sees the complete requests */
+		asm volatile("" : : : "memory");
+		out_long(PVBLK_PORT + 4, 0);
+
+		while (queue.used.idx != queue.avail.idx) {
+			wait_intr();
+		}
+
+		int i;
+		for (i = 0; i < nr_req; i ++) {
+			assert(status[i] == PVBLK_S_OK);
+		}
+	}
+}
+
+void
+pvblk_read(void *buf, uint32_t sector, uint32_t nr_sector) {
+	pvblk_rw(PVBLK_T_IN, buf, sector, nr_sector);
+}
+
+void
+pvblk_write(void *buf, uint32_t sector, uint32_t nr_sector) {
+	pvblk_rw(PVBLK_T_OUT, buf, sector, nr_sector);
+}
+
+void
+init_pvblk(void) {
+	out_long(PVBLK_PORT, (uint32_t)va_to_pa(&queue));
+	add_irq_handle(PVBLK_IRQ, pvblk_intr);
+}
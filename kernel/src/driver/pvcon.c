@@ -0,0 +1,97 @@
+#include "common.h"
+#include "memory.h"
+#include "x86.h"
+
+#include <string.h>
+
+/* Driver of the paravirtual console in NEMU. Output is copied into a ring
+ * in memory and flushed by a single doorbell write per buffer, instead of
+ * one port write per character through the serial port.
+ */
+
+#define PVCON_PORT 0xc0a0
+#define PVCON_IRQ 3
+
+#define PVCON_RING_SIZE 4096
+
+typedef struct {
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint8_t buf[PVCON_RING_SIZE];
+} pvcon_ring;
+
+static pvcon_ring out_ring, in_ring;
+static bool pvcon_ready = false;
+
+void serial_printc(char);
+void add_irq_handle(int, void (*)(void));
+
+static void
+pvcon_intr(void) {
+	/* Nothing to do. Readers check the input ring by themselves. */
+}
+
+static inline void
+pvcon_kick(void) {
+	asm volatile("" : : : "memory");
+	out_long(PVCON_PORT + 8, 0);
+}
+
+void
+pvcon_write(const char *buf, int len) {
+	if (!pvcon_ready) {
+		/* fall back to the serial port before the console is set up */
+		int i;
+		for (i = 0; i < len; i ++) {
+			serial_printc(buf[i]);
+		}
+		return;
+	}
+
+	while (len > 0) {
+		uint32_t head = out_ring.head;
+		uint32_t space = PVCON_RING_SIZE - (head - out_ring.tail);
+		if (space == 0) {
+			/* the device drains the whole ring at every kick */
+			pvcon_kick();
+			continue;
+		}
+
+		uint32_t off = head % PVCON_RING_SIZE;
+		uint32_t n = PVCON_RING_SIZE - off;
+		if (n > space) { n = space; }
+		if (n > len) { n = len; }
+		memcpy(out_ring.buf + off, buf, n);
+		out_ring.head = head + n;
+		buf += n;
+		len -= n;
+	}
+	pvcon_kick();
+}
+
+/* Read at most `len' bytes from the input ring without waiting.
+ * Return the number of bytes read.
+ */
+int
+pvcon_read(char *buf, int len) {
+	if (!pvcon_ready) {
+		return 0;
+	}
+
+	uint32_t tail = in_ring.tail;
+	int nread = 0;
+	while (nread < len && tail != in_ring.head) {
+		buf[nread ++] = in_ring.buf[tail % PVCON_RING_SIZE];
+		tail ++;
+	}
+	in_ring.tail = tail;
+	return nread;
+}
+
+void
+init_pvcon(void) {
+	out_long(PVCON_PORT, (uint32_t)va_to_pa(&out_ring));
+	out_long(PVCON_PORT + 4, (uint32_t)va_to_pa(&in_ring));
+	add_irq_handle(PVCON_IRQ, pvcon_intr);
+	pvcon_ready = true;
+}
@@ -1,8 +1,13 @@
 #include "common.h"
+#include "memory.h"
 #include <string.h>
 
-#define RAMDISK_START ((void *)0)
-#define RAMDISK_SIZE 0xa0000
+/* NEMU puts the program here, see nemu/src/monitor/monitor.c. It is accessed
+ * above KOFFSET, which is mapped in every address space. */
+#define RAMDISK_START 0x800000
+#define RAMDISK_SIZE (PHY_MEM - RAMDISK_START)
+
+uint32_t elf_size(uint32_t);
 
 /* The kernel is monolithic, therefore we do not need to
  * translate the address ``buf'' from the user process to
@@ -11,13 +16,20 @@
 
 /* read `len` bytes starting from `offset` of ramdisk into `buf` */
 void ramdisk_read(uint8_t *buf, uint32_t offset, uint32_t len) {
-	nemu_assert(offset + len < RAMDISK_SIZE);
-	memcpy(buf, RAMDISK_START + offset, len);
+	nemu_assert(offset + len <= RAMDISK_SIZE);
+	memcpy(buf, pa_to_va(RAMDISK_START + offset), len);
 }
 
 /* write `len` bytes starting from `buf` into the `offset` of ramdisk */
 void ramdisk_write(uint8_t *buf, uint32_t offset, uint32_t len) {
-	nemu_assert(offset + len < RAMDISK_SIZE);
-	memcpy(RAMDISK_START + offset, buf, len);
+	nemu_assert(offset + len <= RAMDISK_SIZE);
+	memcpy(pa_to_va(RAMDISK_START + offset), buf, len);
 }
 
+/* Return the physical address of the end of the program in the ramdisk.
+ * The program is read until its process exits, so the page frames below
+ * this address are never allocated.
+ */
+uint32_t ramdisk_end(void) {
+	return RAMDISK_START + elf_size(0);
+}
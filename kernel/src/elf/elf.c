@@ -3,8 +3,6 @@
 #include <string.h>
 #include <elf.h>
 
-#define ELF_OFFSET_IN_DISK 0
-
 #ifdef HAS_DEVICE
 void ide_read(uint8_t *, uint32_t, uint32_t);
 #else
@@ -15,47 +13,114 @@ void ramdisk_read(uint8_t *, uint32_t, uint32_t);
 
 void create_video_mapping();
 uint32_t get_ucr3();
+bool mm_map(uint32_t, uint32_t, uint32_t, uint32_t, bool);
+void mm_set_brk(uint32_t);
+
+static void
+load_read(uint8_t *buf, uint32_t offset, uint32_t len) {
+#ifdef HAS_DEVICE
+	ide_read(buf, offset, len);
+#else
+	ramdisk_read(buf, offset, len);
+#endif
+}
+
+static const uint32_t elf_magic = 0x464c457f;
+
+#if defined(IA32_PAGE) && !defined(IA32_INTR)
+/* Map the segment `ph' and load it page by page, since the frames from
+ * mm_malloc() need not be contiguous in physical memory.
+ */
+static void
+load_segment_paged(Elf32_Phdr *ph, uint32_t elf_offset) {
+	uint32_t va = ph->p_vaddr, end = ph->p_vaddr + ph->p_memsz;
+	uint32_t file_end = ph->p_vaddr + ph->p_filesz;
+	uint32_t offset = elf_offset + ph->p_offset;
+
+	mm_malloc(va, ph->p_memsz);
+	while(va < end) {
+		uint32_t n = PAGE_SIZE - (va & (PAGE_SIZE - 1));
+		if(n > end - va) { n = end - va; }
+		uint32_t nr_file = (va < file_end ? file_end - va : 0);
+		if(nr_file > n) { nr_file = n; }
+
+		/* the page is already mapped, so nothing is allocated */
+		uint8_t *dst = pa_to_va(mm_malloc(va, n));
+		load_read(dst, offset, nr_file);
+		memset(dst + nr_file, 0, n - nr_file);
+
+		va += n;
+		offset += n;
+	}
+}
+#endif
+
+/* Return the size of the ELF file at `elf_offset' in the disk, or 0 if
+ * there is no ELF file. Several programs can be put in the disk one after
+ * another this way.
+ */
+uint32_t elf_size(uint32_t elf_offset) {
+	Elf32_Ehdr elf;
+	load_read((void *)&elf, elf_offset, sizeof(elf));
+	if(*(uint32_t *)elf.e_ident != elf_magic) {
+		return 0;
+	}
+
+	/* the section header table is at the end of the file */
+	uint32_t size = elf.e_shoff + elf.e_shnum * elf.e_shentsize;
+	uint32_t ph_end = elf.e_phoff + elf.e_phnum * sizeof(Elf32_Phdr);
+	return (size > ph_end ? size : ph_end);
+}
 
-uint32_t loader() {
+/* Load the ELF file at `elf_offset' in the disk into the address space of
+ * the current process. Return the entry.
+ */
+uint32_t loader(uint32_t elf_offset) {
 	Elf32_Ehdr *elf;
 	Elf32_Phdr *ph = NULL;
 
 	uint8_t buf[4096];
-
-#ifdef HAS_DEVICE
-	ide_read(buf, ELF_OFFSET_IN_DISK, 4096);
-#else
-	ramdisk_read(buf, ELF_OFFSET_IN_DISK, 4096);
-#endif
+	load_read(buf, elf_offset, 4096);
 
 	elf = (void*)buf;
 
-	/* TODO: fix the magic number with the correct one */
-	const uint32_t elf_magic = 0xBadC0de;
 	uint32_t *p_magic = (void *)buf;
 	nemu_assert(*p_magic == elf_magic);
+	nemu_assert(elf->e_phoff + elf->e_phnum * sizeof(Elf32_Phdr) <= 4096);
 
 	/* Load each program segment */
-	panic("please implement me");
-	for(; true; ) {
+	int i;
+	for(i = 0, ph = (void *)(buf + elf->e_phoff); i < elf->e_phnum; i ++, ph ++) {
 		/* Scan the program header table, load each segment into memory */
 		if(ph->p_type == PT_LOAD) {
+#if defined(IA32_PAGE) && defined(IA32_INTR)
+			/* The segment is read from the disk by the page fault
+			 * handler when it is touched, and the region
+			 * [VirtAddr + FileSiz, VirtAddr + MemSiz) is zero filled.
+			 */
+			nemu_assert(mm_map(ph->p_vaddr, ph->p_vaddr + ph->p_memsz,
+						elf_offset + ph->p_offset, ph->p_filesz, (ph->p_flags & PF_W) != 0));
+#else
+#ifdef IA32_PAGE
+			load_segment_paged(ph, elf_offset);
+#else
+			uint8_t *dst = (void *)ph->p_vaddr;
 
-			/* TODO: read the content of the segment from the ELF file 
+			/* read the content of the segment from the ELF file 
 			 * to the memory region [VirtAddr, VirtAddr + FileSiz)
 			 */
-			 
-			 
-			/* TODO: zero the memory region 
+			load_read(dst, elf_offset + ph->p_offset, ph->p_filesz);
+
+			/* zero the memory region 
 			 * [VirtAddr + FileSiz, VirtAddr + MemSiz)
 			 */
-
+			memset(dst + ph->p_filesz, 0, ph->p_memsz - ph->p_filesz);
+#endif
+#endif
 
 #ifdef IA32_PAGE
 			/* Record the program break for future use. */
-			extern uint32_t brk;
-			uint32_t new_brk = ph->p_vaddr + ph->p_memsz - 1;
-			if(brk < new_brk) { brk = new_brk; }
+			mm_set_brk(ph->p_vaddr + ph->p_memsz - 1);
 #endif
 		}
 	}
@@ -63,6 +128,10 @@ uint32_t loader() {
 	volatile uint32_t entry = elf->e_entry;
 
 #ifdef IA32_PAGE
+	/* The stack is not paged in on demand. The user program runs in ring 0
+	 * without a stack switch, so the CPU could not push the trap frame of
+	 * a fault on the stack into the missing page.
+	 */
 	mm_malloc(KOFFSET - STACK_SIZE, STACK_SIZE);
 
 #ifdef HAS_DEVICE
@@ -1,4 +1,5 @@
 #include "common.h"
+#include "proc.h"
 
 typedef struct {
 	char *name;
@@ -30,5 +31,174 @@ static const file_info file_table[] __attribute__((used)) = {
 void ide_read(uint8_t *, uint32_t, uint32_t);
 void ide_write(uint8_t *, uint32_t, uint32_t);
 
-/* TODO: implement a simplified file system here. */
+#include <string.h>
+
+/* File descriptors 0, 1 and 2 are the standard streams, which are served
+ * by the console in do_syscall(), so files start from FD_FIRST_FILE.
+ * Every process has its own file descriptor table.
+ */
+#define NR_FD 32
+#define FD_FIRST_FILE 3
+
+typedef struct {
+	bool opened;
+	uint32_t offset;
+	const file_info *file;
+} Fstate;
+
+static Fstate fd_tables[NR_PROC][NR_FD];
+
+#define fd_table (fd_tables[proc_slot()])
+
+/* A hash table over the names in file_table[], built by init_fs(). */
+#define NR_HASH 32
+
+static int hash_head[NR_HASH];
+static int hash_next[NR_FILES];
+
+static uint32_t
+name_hash(const char *name) {
+	uint32_t h = 5381;
+	while (*name) {
+		h = h * 33 + (uint8_t)*name ++;
+	}
+	return h % NR_HASH;
+}
+
+static const file_info *
+lookup_file(const char *pathname) {
+	/* all files are in the root directory */
+	const char *name = strrchr(pathname, '/');
+	name = (name ? name + 1 : pathname);
+
+	int i;
+	for (i = hash_head[name_hash(name)]; i != -1; i = hash_next[i]) {
+		if (strcmp(file_table[i].name, name) == 0) {
+			return &file_table[i];
+		}
+	}
+	return NULL;
+}
+
+static Fstate *
+get_fstate(int fd) {
+	if (fd < FD_FIRST_FILE || fd >= NR_FD || !fd_table[fd].opened) {
+		return NULL;
+	}
+	return &fd_table[fd];
+}
+
+void
+init_fs(void) {
+	int i;
+	for (i = 0; i < NR_HASH; i ++) {
+		hash_head[i] = -1;
+	}
+	for (i = 0; i < NR_FILES; i ++) {
+		uint32_t h = name_hash(file_table[i].name);
+		hash_next[i] = hash_head[h];
+		hash_head[h] = i;
+	}
+	memset(fd_tables, 0, sizeof(fd_tables));
+}
+
+/* Close all files of process `slot'. */
+void
+fs_close_all(int slot) {
+	memset(fd_tables[slot], 0, sizeof(fd_tables[slot]));
+}
+
+/* Return the file descriptor, or -1 if there is no such file. */
+int
+fs_open(const char *pathname, int flags) {
+	const file_info *file = lookup_file(pathname);
+	if (file == NULL) {
+		return -1;
+	}
+
+	int fd;
+	for (fd = FD_FIRST_FILE; fd < NR_FD; fd ++) {
+		if (!fd_table[fd].opened) {
+			fd_table[fd].opened = true;
+			fd_table[fd].offset = 0;
+			fd_table[fd].file = file;
+			return fd;
+		}
+	}
+	return -1;
+}
+
+/* Return the number of bytes read, which is less than `len' near the end of file. */
+int
+fs_read(int fd, void *buf, int len) {
+	Fstate *f = get_fstate(fd);
+	if (f == NULL || len < 0) {
+		return -1;
+	}
+
+	uint32_t left = f->file->size - f->offset;
+	if (len > left) { len = left; }
+	ide_read(buf, f->file->disk_offset + f->offset, len);
+	f->offset += len;
+	return len;
+}
+
+/* Files can not grow, writing stops at the end of file. */
+int
+fs_write(int fd, void *buf, int len) {
+	Fstate *f = get_fstate(fd);
+	if (f == NULL || len < 0) {
+		return -1;
+	}
+
+	uint32_t left = f->file->size - f->offset;
+	if (len > left) { len = left; }
+	ide_write(buf, f->file->disk_offset + f->offset, len);
+	f->offset += len;
+	return len;
+}
+
+/* Return the new offset, or -1 if it is out of the file. */
+int
+fs_lseek(int fd, int offset, int whence) {
+	Fstate *f = get_fstate(fd);
+	if (f == NULL) {
+		return -1;
+	}
+
+	int base;
+	switch (whence) {
+		case SEEK_SET: base = 0; break;
+		case SEEK_CUR: base = f->offset; break;
+		case SEEK_END: base = f->file->size; break;
+		default: return -1;
+	}
+	if (base + offset < 0 || base + offset > f->file->size) {
+		return -1;
+	}
+	f->offset = base + offset;
+	return f->offset;
+}
+
+/* Get where the data of the file is in the disk, for mmap(). */
+int
+fs_extent(int fd, uint32_t *disk_offset, uint32_t *size) {
+	Fstate *f = get_fstate(fd);
+	if (f == NULL) {
+		return -1;
+	}
+	*disk_offset = f->file->disk_offset;
+	*size = f->file->size;
+	return 0;
+}
+
+int
+fs_close(int fd) {
+	Fstate *f = get_fstate(fd);
+	if (f == NULL) {
+		return -1;
+	}
+	f->opened = false;
+	return 0;
+}
 
@@ -33,7 +33,9 @@ static void set_trap(GateDesc *ptr, uint32_t selector, uint32_t offset, uint32_t
 
 void irq0();
 void irq1();
+void irq3();
 void irq14();
+void irq15();
 void vec0();
 void vec1();
 void vec2();
@@ -50,8 +52,10 @@ void vec12();
 void vec13();
 void vec14();
 void vecsys();
+void vecexit();
 
 void irq_empty();
+void sysenter_entry();
 
 void init_idt() {
 	int i;
@@ -77,9 +81,22 @@ void init_idt() {
 	/* the system call 0x80 */
 	set_trap(idt + 0x80, SEG_KERNEL_CODE << 3, (uint32_t)vecsys, DPL_USER);
 
+	/* the good and bad traps of user programs, redirected by NEMU */
+	set_trap(idt + 0x81, SEG_KERNEL_CODE << 3, (uint32_t)vecexit, DPL_USER);
+
 	set_intr(idt+32 + 0, SEG_KERNEL_CODE << 3, (uint32_t)irq0, DPL_KERNEL);
+	set_intr(idt+32 + 1, SEG_KERNEL_CODE << 3, (uint32_t)irq1, DPL_KERNEL);
+	set_intr(idt+32 + 3, SEG_KERNEL_CODE << 3, (uint32_t)irq3, DPL_KERNEL);
 	set_intr(idt+32 + 14, SEG_KERNEL_CODE << 3, (uint32_t)irq14, DPL_KERNEL);
+	set_intr(idt+32 + 15, SEG_KERNEL_CODE << 3, (uint32_t)irq15, DPL_KERNEL);
 
 	/* the ``idt'' is its virtual address */
 	write_idtr(idt, sizeof(idt));
+
+	/* System calls can also be made by ``sysenter'', which bypasses the IDT.
+	 * Only the entry is used, see ``sysenter_entry''. */
+	wrmsr(MSR_SYSENTER_CS, SEG_KERNEL_CODE << 3);
+	/* ``sysenter_entry'' runs on the stack of the caller */
+	wrmsr(MSR_SYSENTER_ESP, 0);
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
 }
@@ -1,4 +1,5 @@
 #include "irq.h"
+#include "proc.h"
 
 #define NR_IRQ_HANDLE 32
 
@@ -7,40 +8,104 @@
 
 struct IRQ_t {
 	void (*routine)(void);
+	int owner;	/* the slot of the process which registers it, or -1 for the kernel */
 	struct IRQ_t *next;
 };
 
 static struct IRQ_t handle_pool[NR_IRQ_HANDLE];
 static struct IRQ_t *handles[NR_HARD_INTR];
-static int handle_count = 0;
+
+/* Deferred handlers do the work which is too long for an interrupt
+ * handler. They run after the outermost hardware interrupt, with
+ * interrupts enabled.
+ */
+static struct IRQ_t *deferred;
+static int irq_depth = 0;
 
 void do_syscall(TrapFrame *);
+void do_page_fault(TrapFrame *);
+void proc_exit(int);
+TrapFrame *schedule(TrapFrame *);
+
+/* the good and bad traps of user programs, see init_proc() */
+#define TRAP_VECTOR 0x81
+
+static struct IRQ_t *
+alloc_handle(void (*func)(void), int owner) {
+	int i;
+	for (i = 0; i < NR_IRQ_HANDLE && handle_pool[i].routine != NULL; i ++);
+	assert(i < NR_IRQ_HANDLE);
+
+	struct IRQ_t *ptr = &handle_pool[i]; /* get a free handler */
+	ptr->routine = func;
+	ptr->owner = owner;
+	return ptr;
+}
 
 void
 add_irq_handle(int irq, void (*func)(void) ) {
 	assert(irq < NR_HARD_INTR);
-	assert(handle_count <= NR_IRQ_HANDLE);
 
-	struct IRQ_t *ptr;
-	ptr = &handle_pool[handle_count ++]; /* get a free handler */
-	ptr->routine = func;
+	struct IRQ_t *ptr = alloc_handle(func, -1);
 	ptr->next = handles[irq]; /* insert into the linked list */
 	handles[irq] = ptr;
 }
 
-void irq_handle(TrapFrame *tf) {
-	/* TODO: Re-organize the ``TrapFrame'' structure in `include/irq.h'
-	 * to match the trap frame built during ``do_irq.S''. Remove the 
-	 * following line after you are done.
-	 */
-	panic("Have you re-organized the ``TrapFrame'' structure?");
+/* Register a handler of the running process. The handler is a user
+ * address, so it is only called while the address space of the process
+ * is loaded, i.e. when the process is the current one. The processes
+ * share the stack address, so the kernel cannot switch to another
+ * address space to call it.
+ */
+void
+add_user_irq_handle(int irq, void (*func)(void) ) {
+	assert(irq < NR_HARD_INTR);
+
+	struct IRQ_t *ptr = alloc_handle(func, proc_slot());
+	ptr->next = handles[irq];
+	handles[irq] = ptr;
+}
+
+/* Drop the handlers of the process in `slot', when it exits. */
+void
+remove_irq_handles(int slot) {
+	int irq;
+	for (irq = 0; irq < NR_HARD_INTR; irq ++) {
+		struct IRQ_t **pp = &handles[irq];
+		while (*pp != NULL) {
+			if ((*pp)->owner == slot) {
+				(*pp)->routine = NULL;
+				*pp = (*pp)->next;
+			}
+			else {
+				pp = &(*pp)->next;
+			}
+		}
+	}
+}
 
+void
+add_deferred_handle(void (*func)(void) ) {
+	struct IRQ_t *ptr = alloc_handle(func, -1);
+	ptr->next = deferred;
+	deferred = ptr;
+}
+
+/* Return the trap frame to resume, which belongs to another process if
+ * the scheduler switches. */
+TrapFrame *irq_handle(TrapFrame *tf) {
 	int irq = tf->irq;
 
 	if (irq < 0) {
 		panic("Unhandled exception!");
 	} else if (irq == 0x80) {
 		do_syscall(tf);
+#ifdef IA32_PAGE
+	} else if (irq == 14) {
+		do_page_fault(tf);
+	} else if (irq == TRAP_VECTOR) {
+		proc_exit(tf->eax);
+#endif
 	} else if (irq < 1000) {
 		panic("Unexpected exception #%d at eip = %x", irq, tf->eip);
 	} else if (irq >= 1000) {
@@ -48,10 +113,23 @@ void irq_handle(TrapFrame *tf) {
 		assert(irq_id < NR_HARD_INTR);
 		struct IRQ_t *f = handles[irq_id];
 
+		irq_depth ++;
 		while (f != NULL) { /* call handlers one by one */
-			f->routine(); 
+			if (f->owner < 0 || f->owner == proc_slot()) {
+				f->routine(); 
+			}
 			f = f->next;
 		}
+
+		if (irq_depth == 1) {
+			sti();
+			for (f = deferred; f != NULL; f = f->next) {
+				f->routine();
+			}
+			cli();
+		}
+		irq_depth --;
 	}
+	return schedule(tf);
 }
 
@@ -1,7 +1,7 @@
 #include "common.h"
 #include <stdio.h>
 
-void serial_printc(char);
+void pvcon_write(const char *, int);
 
 /* __attribute__((__noinline__))  here is to disable inlining for this function to avoid some optimization problems for gcc 4.7 */
 void __attribute__((__noinline__)) 
@@ -12,8 +12,6 @@ printk(const char *ctl, ...) {
 	static char buf[256];
 	void *args = (void **)&ctl + 1;
 	int len = vsnprintf(buf, 256, ctl, args);
-	int i;
-	for(i = 0; i < len; i ++) {
-		serial_printc(buf[i]);
-	}
+	if(len > 255) { len = 255; }
+	pvcon_write(buf, len);
 }
@@ -3,12 +3,17 @@
 
 void init_page();
 void init_serial();
+void init_pvcon();
 void init_ide();
+void init_fs();
 void init_i8259();
 void init_segment();
 void init_idt();
 void init_mm();
-uint32_t loader();
+uint32_t loader(uint32_t);
+void init_proc();
+void mmap_write_test();
+void proc_run();
 
 void video_mapping_write_test();
 void video_mapping_read_test();
@@ -55,6 +60,9 @@ void init_cond() {
 	/* Initialize the serial port. After that, you can use printk() to output messages. */
 	init_serial();
 
+	/* Initialize the paravirtual console, which makes printk() much cheaper. */
+	init_pvcon();
+
 	/* Initialize the IDE driver. */
 	init_ide();
 
@@ -67,6 +75,9 @@ void init_cond() {
 	init_mm();
 #endif
 
+	/* Initialize the file system, which does not depend on the devices. */
+	init_fs();
+
 	/* Output a welcome message.
 	 * Note that the output is actually performed only when
 	 * the serial port is available in NEMU.
@@ -78,9 +89,19 @@ void init_cond() {
 	video_mapping_write_test();
 #endif
 
+#ifdef IA32_PAGE
+	/* Create a process for every program in the disk. */
+	init_proc();
+
+#ifdef IA32_INTR
+	/* Check that read-only file mappings can not be written. */
+	mmap_write_test();
+#endif
+#else
 	/* Load the program. */
-	uint32_t eip = loader();
-	
+	uint32_t eip = loader(0);
+#endif
+
 #if defined(IA32_PAGE) && defined(HAS_DEVICE)
 	/* Read data in the video memory to check whether 
 	 * the test data is written sucessfully.
@@ -92,17 +113,16 @@ void init_cond() {
 #endif
 
 #ifdef IA32_PAGE
-	/* Set the %esp for user program, which is one of the
-	 * convention of the "advanced" runtime environment. */
-	asm volatile("movl %0, %%esp" : : "i"(KOFFSET));
-#endif
-
+	/* Here we go! The processes are switched by the scheduler. */
+	proc_run();
+#else
 	/* Keep the `bt' command happy. */
 	asm volatile("movl $0, %ebp");
 	asm volatile("subl $16, %esp");
 
 	/* Here we go! */
 	((void(*)(void))eip)();
+#endif
 
 	panic("should not reach here");
 }
@@ -0,0 +1,160 @@
+#include "common.h"
+#include "memory.h"
+#include <string.h>
+
+/* A buddy allocator of physical page frames. The frames above the memory
+ * of the kernel are grouped into blocks of 2^order frames, and the free
+ * blocks of each order are kept in a doubly linked list. A block is split
+ * into two buddies to serve a smaller request, and is merged with its buddy
+ * when both of them are free again, so both allocation and freeing take
+ * O(MAX_ORDER) steps.
+ */
+
+#define FRAME_START (KMEM / PAGE_SIZE)
+#define FRAME_END   (PHY_MEM / PAGE_SIZE)
+#define NR_FRAME    (FRAME_END - FRAME_START)
+#define NIL         0xffff
+
+#ifndef HAS_DEVICE
+uint32_t ramdisk_end(void);
+#endif
+
+typedef struct {
+	uint16_t prev, next;	/* links in the free list, only valid for the head of a free block */
+	uint8_t order;			/* the order of the block, only valid for the head of a block */
+	bool free;
+} Frame;
+
+static Frame frame[NR_FRAME];
+static uint16_t free_list[MAX_ORDER + 1];
+static uint32_t nr_free[MAX_ORDER + 1];
+
+static inline void
+list_add(int idx, int order) {
+	frame[idx].order = order;
+	frame[idx].free = true;
+	frame[idx].prev = NIL;
+	frame[idx].next = free_list[order];
+	if (free_list[order] != NIL) {
+		frame[free_list[order]].prev = idx;
+	}
+	free_list[order] = idx;
+	nr_free[order] ++;
+}
+
+static inline void
+list_del(int idx, int order) {
+	Frame *f = &frame[idx];
+	if (f->prev != NIL) { frame[f->prev].next = f->next; }
+	else { free_list[order] = f->next; }
+	if (f->next != NIL) { frame[f->next].prev = f->prev; }
+	f->free = false;
+	nr_free[order] --;
+}
+
+/* Free the block of 2^order frames at `idx', merging it with its buddies. */
+static void
+free_block(int idx, int order) {
+	while (order < MAX_ORDER) {
+		int buddy = idx ^ (1 << order);
+		if (buddy >= NR_FRAME || !frame[buddy].free || frame[buddy].order != order) {
+			break;
+		}
+		list_del(buddy, order);
+		idx &= buddy;
+		order ++;
+	}
+	list_add(idx, order);
+}
+
+/* Free `nr' frames starting at `idx' as the largest aligned blocks. */
+static void
+free_range(int idx, int nr) {
+	while (nr > 0) {
+		int order = 0;
+		while (order < MAX_ORDER && (idx & (1 << order)) == 0 && (2 << order) <= nr) {
+			order ++;
+		}
+		free_block(idx, order);
+		idx += 1 << order;
+		nr -= 1 << order;
+	}
+}
+
+/* Allocate `nr' contiguous page frames. The block which serves the request
+ * is rounded up to a power of two, and the frames beyond `nr' are given
+ * back. Return the physical address of the first frame, or 0 if there is
+ * no such block.
+ */
+uint32_t
+alloc_pages(int nr) {
+	assert(nr > 0 && nr <= (1 << MAX_ORDER));
+
+	int order = 0;
+	while ((1 << order) < nr) { order ++; }
+
+	int o = order;
+	while (o <= MAX_ORDER && free_list[o] == NIL) { o ++; }
+	if (o > MAX_ORDER) {
+		return 0;
+	}
+
+	int idx = free_list[o];
+	list_del(idx, o);
+
+	/* split the block, and give back the upper halves */
+	while (o > order) {
+		o --;
+		list_add(idx + (1 << o), o);
+	}
+	frame[idx].order = order;
+
+	if (nr < (1 << order)) {
+		free_range(idx + nr, (1 << order) - nr);
+	}
+	return (FRAME_START + idx) * PAGE_SIZE;
+}
+
+/* Free `nr' contiguous page frames starting at physical address `pa'. The
+ * frames need not be allocated together.
+ */
+void
+free_pages(uint32_t pa, int nr) {
+	int idx = pa / PAGE_SIZE - FRAME_START;
+	assert(pa % PAGE_SIZE == 0 && idx >= 0 && idx + nr <= NR_FRAME);
+	free_range(idx, nr);
+}
+
+/* Print the number of free blocks of each order. */
+void
+buddy_stat(void) {
+	uint32_t total = 0;
+	int i;
+	for (i = 0; i <= MAX_ORDER; i ++) {
+		total += nr_free[i] << i;
+	}
+	printk("page frames: %d free of %d\n", total, NR_FRAME);
+	for (i = 0; i <= MAX_ORDER; i ++) {
+		printk("  order %2d (%4dKB): %d free\n", i, 4 << i, nr_free[i]);
+	}
+}
+
+void
+init_buddy(void) {
+	int i;
+	for (i = 0; i <= MAX_ORDER; i ++) {
+		free_list[i] = NIL;
+		nr_free[i] = 0;
+	}
+	memset(frame, 0, sizeof(frame));
+
+	int first = 0;
+#ifndef HAS_DEVICE
+	/* a large program in the ramdisk extends above KMEM */
+	uint32_t end = ramdisk_end();
+	if (end > KMEM) {
+		first = (end - KMEM + PAGE_SIZE - 1) / PAGE_SIZE;
+	}
+#endif
+	free_range(first, NR_FRAME - first);
+}
@@ -4,7 +4,6 @@
 #include <string.h>
 
 static PDE kpdir[NR_PDE] align_to_page;						// kernel page directory
-static PTE kptable[PHY_MEM / PAGE_SIZE] align_to_page;		// kernel page tables
 
 PDE* get_kpdir() { return kpdir; }
 
@@ -12,56 +11,40 @@ PDE* get_kpdir() { return kpdir; }
 void init_page(void) {
 	CR0 cr0;
 	CR3 cr3;
+	CR4 cr4;
 	PDE *pdir = (PDE *)va_to_pa(kpdir);
-	PTE *ptable = (PTE *)va_to_pa(kptable);
 	uint32_t pdir_idx;
 
 	/* make all PDEs invalid */
 	memset(pdir, 0, NR_PDE * sizeof(PDE));
 
-	/* fill PDEs */
+	/* Map the physical memory with 4MB pages, so no page table is needed.
+	 * Each PDE is used both for the identical mapping and for the mapping
+	 * above KOFFSET.
+	 */
 	for (pdir_idx = 0; pdir_idx < PHY_MEM / PT_SIZE; pdir_idx ++) {
-		pdir[pdir_idx].val = make_pde(ptable);
-		pdir[pdir_idx + KOFFSET / PT_SIZE].val = make_pde(ptable);
-
-		ptable += NR_PTE;
+		PDE pde;
+		pde.val = make_pde(pdir_idx * PT_SIZE);
+		pde.page_size = 1;
+		pdir[pdir_idx] = pde;
+		pdir[pdir_idx + KOFFSET / PT_SIZE] = pde;
 	}
 
-	/* fill PTEs */
-
-	/* We use inline assembly here to fill PTEs for efficiency.
-	 * If you do not understand it, refer to the C code below.
-	 */
-
-	asm volatile ("std;\
-	 1: stosl;\
-		subl %0, %%eax;\
-		jge 1b" : : 
-		"i"(PAGE_SIZE), "a"((PHY_MEM - PAGE_SIZE) | 0x7), "D"(ptable - 1));
-
-
-	/*
-		===== referenced code for the inline assembly above =====
-
-		uint32_t pframe_addr = PHY_MEM - PAGE_SIZE;
-		ptable --;
-
-		// fill PTEs reversely
-		for (; pframe_addr >= 0; pframe_addr -= PAGE_SIZE) {
-			ptable->val = make_pte(pframe_addr);
-			ptable --;
-		}
-	*/
-
+	/* set PSE bit in CR4 to enable 4MB pages */
+	cr4.val = read_cr4();
+	cr4.page_size_extension = 1;
+	write_cr4(cr4.val);
 
 	/* make CR3 to be the entry of page directory */
 	cr3.val = 0;
 	cr3.page_directory_base = ((uint32_t)pdir) >> 12;
 	write_cr3(cr3.val);
 
-	/* set PG bit in CR0 to enable paging */
+	/* Set PG bit in CR0 to enable paging. Everything runs in ring 0, so
+	 * read-only pages are only enforced with the WP bit. */
 	cr0.val = read_cr0();
 	cr0.paging = 1;
+	cr0.write_protect = 1;
 	write_cr0(cr0.val);
 }
 
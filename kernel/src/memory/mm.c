@@ -1,35 +1,177 @@
 #include "common.h"
 #include "memory.h"
+#include "x86.h"
+#include "proc.h"
 #include <string.h>
 
-static PDE updir[NR_PDE] align_to_page;
-static CR3 ucr3;
+/* Every process has its own page directory and program break. */
+static PDE updir[NR_PROC][NR_PDE] align_to_page;
+static uint32_t brk[NR_PROC];
 
-PDE* get_updir() { return updir; }
-uint32_t get_ucr3() { return ucr3.val; }
+PDE* get_updir() { return updir[proc_slot()]; }
+uint32_t get_ucr3() { return (uint32_t)va_to_pa(get_updir()) & ~0xfff; }
 
 PDE* get_kpdir();
+uint32_t alloc_pages(int);
+void free_pages(uint32_t, int);
+void init_buddy();
 
-uint32_t brk = 0;
+#define page_down(va) ((va) & ~(PAGE_SIZE - 1))
+#define page_up(va) page_down((va) + PAGE_SIZE - 1)
+
+/* Return the PTE of `va' in the user page directory. If `create' is true,
+ * a missing page table is allocated, otherwise NULL is returned.
+ */
+static PTE* get_upte(uint32_t va, bool create) {
+	PDE *pde = &get_updir()[va / PT_SIZE];
+	if(!pde->present) {
+		if(!create) { return NULL; }
+		uint32_t pt = alloc_pages(1);
+		nemu_assert(pt != 0);
+		memset(pa_to_va(pt), 0, PAGE_SIZE);
+		pde->val = make_pde(pt);
+	}
+	PTE *ptable = pa_to_va(pde->page_frame << 12);
+	return &ptable[(va / PAGE_SIZE) % NR_PTE];
+}
+
+/* Map the pages of [va, va + len) which are not mapped yet in the user
+ * address space. The new frames are allocated in blocks as large as
+ * possible, but they are NOT guaranteed to be contiguous in physical
+ * memory. Return the physical address of `va'.
+ */
+uint32_t mm_malloc(uint32_t va, int len) {
+	if(len <= 0) { return 0; }
+
+	uint32_t start = page_down(va), end = page_up(va + len);
+	uint32_t addr;
+	int nr = 0;
+	for(addr = start; addr != end; addr += PAGE_SIZE) {
+		PTE *pte = get_upte(addr, true);
+		if(!pte->present) { nr ++; }
+	}
+
+	while(nr > 0) {
+		/* the run may be larger than the largest block */
+		uint32_t pa = 0;
+		int n = (nr > (1 << MAX_ORDER) ? (1 << MAX_ORDER) : nr);
+		while((pa = alloc_pages(n)) == 0) {
+			n >>= 1;
+			nemu_assert(n > 0);
+		}
+		nr -= n;
+
+		for(addr = start; n > 0; addr += PAGE_SIZE) {
+			PTE *pte = get_upte(addr, false);
+			if(!pte->present) {
+				pte->val = make_pte(pa);
+				pa += PAGE_SIZE;
+				n --;
+			}
+		}
+		start = addr;
+	}
+
+	return (get_upte(va, false)->page_frame << 12) | (va & (PAGE_SIZE - 1));
+}
+
+/* Unmap the pages of [va, va + len) in the user address space, and give
+ * their frames back. Page tables are kept.
+ */
+void mm_unmap(uint32_t va, uint32_t len) {
+	uint32_t addr;
+	for(addr = page_down(va); addr < va + len; addr += PAGE_SIZE) {
+		PTE *pte = get_upte(addr, false);
+		if(pte != NULL && pte->present) {
+			free_pages(pte->page_frame << 12, 1);
+			pte->val = make_invalid_pte();
+		}
+	}
+	write_cr3(get_ucr3());
+}
+
+bool mm_map(uint32_t, uint32_t, uint32_t, uint32_t, bool);
+void mm_vma_reset(int);
+
+/* Record the end of the program as the initial break. */
+void mm_set_brk(uint32_t new_brk) {
+	if(brk[proc_slot()] < new_brk) { brk[proc_slot()] = new_brk; }
+}
 
 /* The brk() system call handler. */
 void mm_brk(uint32_t new_brk) {
-	if(new_brk > brk) {
-		mm_malloc(brk, new_brk - brk);
+	uint32_t *cur = &brk[proc_slot()];
+	if(new_brk > *cur) {
+#if defined(IA32_PAGE) && defined(IA32_INTR)
+		/* the new part of the heap is zero filled when it is touched */
+		nemu_assert(mm_map(*cur, new_brk, 0, 0, true));
+#else
+		mm_malloc(*cur, new_brk - *cur);
+#endif
 	}
-	brk = new_brk;
+	else if(page_up(new_brk) < page_up(*cur)) {
+		/* give back the pages above the new break */
+		mm_unmap(page_up(new_brk), page_up(*cur) - page_up(new_brk));
+	}
+	*cur = new_brk;
 }
 
-void init_mm() {
+static inline bool is_free_frame(uint32_t pa) {
+	/* frames out of the buddy allocator, e.g. the video memory, are not freed */
+	return pa >= KMEM && pa < PHY_MEM;
+}
+
+/* Give back all user pages and page tables of process `slot'. The page
+ * directory is left as it is, since the process may still be running on
+ * its stack until it is switched out. mm_new() clears it.
+ */
+void mm_release(int slot) {
+	int i, j;
+	for(i = 0; i < KOFFSET / PT_SIZE; i ++) {
+		PDE *pde = &updir[slot][i];
+		if(!pde->present) { continue; }
+
+		PTE *ptable = pa_to_va(pde->page_frame << 12);
+		for(j = 0; j < NR_PTE; j ++) {
+			if(ptable[j].present && is_free_frame(ptable[j].page_frame << 12)) {
+				free_pages(ptable[j].page_frame << 12, 1);
+			}
+		}
+		if(is_free_frame(pde->page_frame << 12)) {
+			free_pages(pde->page_frame << 12, 1);
+		}
+	}
+}
+
+/* Set up an empty address space for process `slot'. */
+void mm_new(int slot) {
 	PDE *kpdir = get_kpdir();
 
 	/* make all PDE invalid */
-	memset(updir, 0, NR_PDE * sizeof(PDE));
+	memset(updir[slot], 0, NR_PDE * sizeof(PDE));
 
 	/* create the same mapping above 0xc0000000 as the kernel mapping does */
-	memcpy(&updir[KOFFSET / PT_SIZE], &kpdir[KOFFSET / PT_SIZE], 
+	memcpy(&updir[slot][KOFFSET / PT_SIZE], &kpdir[KOFFSET / PT_SIZE], 
 			(PHY_MEM / PT_SIZE) * sizeof(PDE));
 
-	ucr3.val = (uint32_t)va_to_pa((uint32_t)updir) & ~0xfff;
+	brk[slot] = 0;
+#ifdef IA32_PAGE
+	mm_vma_reset(slot);
+#endif
 }
 
+/* Return the kernel address of the user address `va' of process `slot', or
+ * NULL if it is not mapped. It works in any address space.
+ */
+void* mm_user_ptr(int slot, uint32_t va) {
+	PDE *pde = &updir[slot][va / PT_SIZE];
+	if(!pde->present) { return NULL; }
+	PTE *pte = (PTE *)pa_to_va(pde->page_frame << 12) + (va / PAGE_SIZE) % NR_PTE;
+	if(!pte->present) { return NULL; }
+	return pa_to_va((pte->page_frame << 12) | (va & (PAGE_SIZE - 1)));
+}
+
+void init_mm() {
+	init_buddy();
+	mm_new(0);
+}
@@ -0,0 +1,282 @@
+#include "common.h"
+#include "memory.h"
+#include "x86.h"
+#include "irq.h"
+#include "proc.h"
+#include <string.h>
+
+/* Virtual memory areas of the user process: the segments of the program,
+ * the heap and the read-only file mappings created by the mmap()
+ * system call. No page is allocated when an area is created. A page is
+ * allocated at the first access by the page fault handler, and it is
+ * either read from the disk, or filled with zeros if the area is anonymous.
+ * Pages of file data are read together with the following pages of the
+ * area (fault-around), so that a sequential scan takes a few faults and
+ * large disk transfers.
+ */
+
+#ifdef IA32_PAGE
+
+#define MMAP_START   0x40000000
+#define MMAP_END     (KOFFSET - (1 << 20))	/* below the user stack */
+#define NR_VMA       32
+#define FAULT_AROUND 16
+
+typedef struct {
+	bool used;
+	bool writable;
+	uint32_t start, end;	/* not necessarily aligned to pages */
+	uint32_t disk_offset;	/* where the data at `start' is in the disk */
+	uint32_t file_len;		/* the length of the file data, the rest is zero */
+} VMA;
+
+/* the areas of every process, those of the current process are used */
+static VMA vma_table[NR_PROC][NR_VMA];
+static uint32_t mmap_brk_table[NR_PROC];
+
+#define vma (vma_table[proc_slot()])
+#define mmap_brk (mmap_brk_table[proc_slot()])
+
+#ifdef HAS_DEVICE
+void ide_read(uint8_t *, uint32_t, uint32_t);
+#else
+void ramdisk_read(uint8_t *, uint32_t, uint32_t);
+#endif
+
+PDE* get_updir();
+uint32_t get_ucr3();
+void mm_unmap(uint32_t, uint32_t);
+
+static void
+disk_read(uint8_t *buf, uint32_t offset, uint32_t len) {
+#ifdef HAS_DEVICE
+	ide_read(buf, offset, len);
+#else
+	ramdisk_read(buf, offset, len);
+#endif
+}
+
+/* Remove all areas of process `slot'. */
+void
+mm_vma_reset(int slot) {
+	memset(vma_table[slot], 0, sizeof(vma_table[slot]));
+	mmap_brk_table[slot] = MMAP_START;
+}
+
+/* Create an area [start, end) whose first `file_len' bytes are at
+ * `disk_offset' in the disk. An anonymous area is merged into the area
+ * right below it if they are alike, so that growing the heap piece by
+ * piece does not use up the areas. Return whether it is created.
+ */
+bool
+mm_map(uint32_t start, uint32_t end, uint32_t disk_offset, uint32_t file_len, bool writable) {
+	int i;
+	if (file_len == 0) {
+		for (i = 0; i < NR_VMA; i ++) {
+			if (vma[i].used && vma[i].end == start && vma[i].writable == writable) {
+				vma[i].end = end;
+				return true;
+			}
+		}
+	}
+
+	for (i = 0; i < NR_VMA; i ++) {
+		if (!vma[i].used) {
+			vma[i].used = true;
+			vma[i].writable = writable;
+			vma[i].start = start;
+			vma[i].end = end;
+			vma[i].disk_offset = disk_offset;
+			vma[i].file_len = file_len;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Map `len' bytes at `offset' of the file whose data is at `disk_offset'
+ * in the disk and `file_size' bytes long. Return the virtual address of
+ * the mapping, or -1 on error.
+ */
+uint32_t
+mm_mmap(uint32_t len, uint32_t disk_offset, uint32_t file_size, uint32_t offset) {
+	if (len == 0 || (offset & (PAGE_SIZE - 1)) != 0 || offset > file_size) {
+		return -1;
+	}
+
+	uint32_t size = (len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	if (size > MMAP_END - mmap_brk) {
+		return -1;
+	}
+
+	uint32_t file_len = (file_size - offset < len ? file_size - offset : len);
+	if (!mm_map(mmap_brk, mmap_brk + size, disk_offset + offset, file_len, false)) {
+		return -1;
+	}
+
+	mmap_brk += size;
+	return mmap_brk - size;
+}
+
+static VMA *
+find_vma(uint32_t addr) {
+	int i;
+	for (i = 0; i < NR_VMA; i ++) {
+		if (vma[i].used && addr >= vma[i].start && addr < vma[i].end) {
+			return &vma[i];
+		}
+	}
+	return NULL;
+}
+
+static PTE *
+get_pte(uint32_t va) {
+	PDE *pde = &get_updir()[va / PT_SIZE];
+	if (!pde->present) {
+		return NULL;
+	}
+	PTE *ptable = pa_to_va(pde->page_frame << 12);
+	return &ptable[(va / PAGE_SIZE) % NR_PTE];
+}
+
+/* Allocate the page at `va' and fill it with the data of all the areas
+ * overlapping it, since an area does not necessarily start or end at a
+ * page boundary.
+ */
+static void
+map_page(uint32_t va) {
+	uint8_t *page = pa_to_va(mm_malloc(va, PAGE_SIZE));
+	memset(page, 0, PAGE_SIZE);
+
+	bool writable = false;
+	int i;
+	for (i = 0; i < NR_VMA; i ++) {
+		VMA *v = &vma[i];
+		if (!v->used || v->end <= va || v->start >= va + PAGE_SIZE) {
+			continue;
+		}
+		writable |= v->writable;
+
+		uint32_t lo = (v->start > va ? v->start : va);
+		uint32_t hi = v->start + v->file_len;
+		if (hi > va + PAGE_SIZE) { hi = va + PAGE_SIZE; }
+		if (lo < hi) {
+			disk_read(page + (lo - va), v->disk_offset + (lo - v->start), hi - lo);
+		}
+	}
+
+	get_pte(va)->read_write = writable;
+}
+
+static inline bool
+page_present(uint32_t va) {
+	PTE *pte = get_pte(va);
+	return pte != NULL && pte->present;
+}
+
+/* Return whether the fault at `addr' is served. */
+bool
+mm_fault(uint32_t addr) {
+	VMA *v = find_vma(addr);
+	uint32_t va = addr & ~(PAGE_SIZE - 1);
+	if (v == NULL || page_present(va)) {
+		/* an invalid address, or a write into a read-only page */
+		return false;
+	}
+
+	map_page(va);
+
+	/* Only file data is worth reading ahead, zero pages are not. */
+	uint32_t file_end = v->start + v->file_len;
+	int i;
+	for (i = 1, va += PAGE_SIZE; i < FAULT_AROUND && va < file_end; i ++, va += PAGE_SIZE) {
+		if (!page_present(va)) {
+			map_page(va);
+		}
+	}
+
+	/* drop the stale translations */
+	write_cr3(get_ucr3());
+	return true;
+}
+
+/* Map the pages of [addr, addr + len) which are not present. The kernel
+ * calls it before the disk driver accesses a user buffer, since a page
+ * fault inside the driver would re-enter it.
+ */
+void
+mm_populate(uint32_t addr, uint32_t len) {
+	if (len == 0) {
+		return;
+	}
+
+	uint32_t va;
+	bool mapped = false;
+	for (va = addr & ~(PAGE_SIZE - 1); va <= addr + len - 1; va += PAGE_SIZE) {
+		if (!page_present(va) && find_vma(va > addr ? va : addr) != NULL) {
+			map_page(va);
+			mapped = true;
+		}
+	}
+
+	if (mapped) {
+		write_cr3(get_ucr3());
+	}
+}
+
+/* Where the kernel continues if the next access faults and the fault is
+ * not served, instead of a panic. It is used by the test below. */
+uint32_t fault_fixup = 0;
+
+void
+do_page_fault(TrapFrame *tf) {
+	uint32_t addr = read_cr2();
+	if (!mm_fault(addr)) {
+		if (fault_fixup != 0) {
+			tf->eip = fault_fixup;
+			fault_fixup = 0;
+			return;
+		}
+		panic("Page fault at eip = %x, address = %x, error code = %x", tf->eip, addr, tf->error_code);
+	}
+}
+
+/* Return whether writing a byte at `p' faults. */
+static bool
+write_faults(volatile uint8_t *p) {
+	bool faulted;
+	asm volatile(
+			"movl $1f, fault_fixup\n\t"
+			"movb $0, (%1)\n\t"
+			"movl $0, fault_fixup\n\t"
+			"movb $0, %0\n\t"
+			"jmp 2f\n"
+			"1: movb $1, %0\n"
+			"2:"
+			: "=q"(faulted) : "r"(p) : "memory");
+	return faulted;
+}
+
+/* Check that a page of a read-only file mapping can be read but not
+ * written, in the address space of the current process. The mapping is
+ * removed afterwards.
+ */
+void
+mmap_write_test(void) {
+	write_cr3(get_ucr3());
+
+	/* the first page of the disk */
+	uint32_t va = mm_mmap(PAGE_SIZE, 0, PAGE_SIZE, 0);
+	assert(va != -1);
+	volatile uint8_t *p = (void *)va;
+	uint8_t old = *p;
+
+	assert(write_faults(p));
+	assert(*p == old);
+
+	find_vma(va)->used = false;
+	mmap_brk -= PAGE_SIZE;
+	mm_unmap(va, PAGE_SIZE);
+}
+
+#endif
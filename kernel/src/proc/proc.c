@@ -0,0 +1,273 @@
+#include "common.h"
+#include "memory.h"
+#include "x86.h"
+#include "proc.h"
+#include <string.h>
+
+/* Processes and the round-robin scheduler. Every program found in the disk
+ * becomes a process when the kernel boots. A process is switched when the
+ * kernel is about to return to user code, after its time slice is used up
+ * (at a tick of the timer) or when it exits or waits. When no process is
+ * left, NEMU is stopped with a good trap if all of them exit with 0.
+ */
+
+/* the CR3 to load before resuming the trap frame returned by schedule(),
+ * see ``irq_switch'' in do_irq.S */
+uint32_t proc_cr3;
+
+#ifdef IA32_PAGE
+
+/* the interrupt for the good and bad traps of user programs, see trap.h */
+#define TRAP_VECTOR 0x81
+
+#define EFLAGS_IF 0x200
+
+static PCB pcb[NR_PROC];
+static int cur = 0;
+static int next_pid = 1;
+static bool need_resched = false;
+static int nr_exited = 0, nr_failed = 0;
+
+uint32_t loader(uint32_t);
+uint32_t elf_size(uint32_t);
+uint32_t get_ucr3();
+void mm_new(int);
+void mm_release(int);
+void *mm_user_ptr(int, uint32_t);
+void mm_populate(uint32_t, uint32_t);
+void fs_close_all(int);
+void add_irq_handle(int, void (*)(void));
+void remove_irq_handles(int);
+void buddy_stat();
+
+int proc_slot() { return cur; }
+
+/* Create a process running the ELF file at `elf_offset' in the disk.
+ * Return its pid.
+ */
+static int
+proc_create(uint32_t elf_offset) {
+	int slot;
+	for (slot = 0; slot < NR_PROC && pcb[slot].state != PROC_UNUSED; slot ++);
+	assert(slot < NR_PROC);
+
+	/* the loader works in the address space of the current process */
+	int old = cur;
+	cur = slot;
+	mm_new(slot);
+	fs_close_all(slot);
+	uint32_t entry = loader(elf_offset);
+
+	/* The process starts as if it is returning from an interrupt, with
+	 * the stack at KOFFSET - 16 as the old loader did. The stack is
+	 * already mapped by the loader.
+	 */
+	TrapFrame *tf = (TrapFrame *)(KOFFSET - 16) - 1;
+	TrapFrame *ktf = mm_user_ptr(slot, (uint32_t)tf);
+	memset(ktf, 0, sizeof(TrapFrame));
+	ktf->eip = entry;
+	ktf->cs = SEG_KERNEL_CODE << 3;
+	ktf->eflags = EFLAGS_IF;
+
+	PCB *p = &pcb[slot];
+	p->state = PROC_READY;
+	p->pid = next_pid ++;
+	p->parent = -1;
+	p->tf = tf;
+
+	cur = old;
+	return p->pid;
+}
+
+/* Give the exit status of process `slot' to its parent, at `status_addr'
+ * of the parent if it is not 0, and let the process be gone. Return its pid.
+ */
+static int
+reap(int slot, uint32_t status_addr) {
+	PCB *p = &pcb[slot];
+	if (status_addr != 0) {
+		int *status = mm_user_ptr(p->parent, status_addr);
+		if (status) { *status = (p->exit_status & 0xff) << 8; }
+	}
+	p->state = PROC_UNUSED;
+	return p->pid;
+}
+
+static inline bool
+is_child(int slot, int parent, int pid) {
+	return pcb[slot].state != PROC_UNUSED && pcb[slot].parent == parent &&
+		(pid == -1 || pcb[slot].pid == pid);
+}
+
+/* The exit() system call, and the good or bad trap of a program. */
+void
+proc_exit(int status) {
+	PCB *p = &pcb[cur];
+
+	/* the process keeps running on its stack until it is switched out,
+	 * which does not allocate memory */
+	mm_release(cur);
+	fs_close_all(cur);
+	cli();
+	remove_irq_handles(cur);
+	sti();
+	p->exit_status = status;
+
+	int i;
+	for (i = 0; i < NR_PROC; i ++) {
+		if (is_child(i, cur, -1)) {
+			/* the kernel takes care of the orphans */
+			if (pcb[i].state == PROC_ZOMBIE) { pcb[i].state = PROC_UNUSED; }
+			pcb[i].parent = -1;
+		}
+	}
+
+	if (p->parent < 0) {
+		nr_exited ++;
+		if (status != 0) { nr_failed ++; }
+		p->state = PROC_UNUSED;
+		return;
+	}
+
+	p->state = PROC_ZOMBIE;
+	PCB *parent = &pcb[p->parent];
+	if (parent->state == PROC_WAITING && (parent->wait_pid == -1 || parent->wait_pid == p->pid)) {
+		/* wait() of the parent returns the pid, through its trap frame */
+		uint32_t *eax = mm_user_ptr(p->parent, (uint32_t)&parent->tf->eax);
+		*eax = reap(cur, parent->wait_status);
+		parent->state = PROC_READY;
+	}
+}
+
+/* The waitpid() system call. `pid' is -1 for any child. If the child has
+ * not exited, the process waits, and the result is put into its trap frame
+ * when the child exits. Return -1 if there is no such child.
+ */
+int
+proc_wait(int pid, uint32_t status) {
+	int i;
+	bool found = false;
+	for (i = 0; i < NR_PROC; i ++) {
+		if (is_child(i, cur, pid)) {
+			found = true;
+			if (pcb[i].state == PROC_ZOMBIE) {
+				return reap(i, status);
+			}
+		}
+	}
+	if (!found) {
+		return -1;
+	}
+
+	/* make sure the status can be stored from another address space */
+	if (status != 0) { mm_populate(status, sizeof(int)); }
+	pcb[cur].state = PROC_WAITING;
+	pcb[cur].wait_pid = pid;
+	pcb[cur].wait_status = status;
+	return 0;
+}
+
+static void
+finish(void) {
+	printk("%d programs exited, %d failed\n", nr_exited, nr_failed);
+	nemu_set_trap_vector(-1, 0);
+	if (nr_failed == 0) {
+		HIT_GOOD_TRAP;
+	}
+	else {
+		HIT_BAD_TRAP;
+	}
+}
+
+/* Called with the trap frame which the kernel is about to return to.
+ * Return the trap frame to return to, which belongs to another process if
+ * the scheduler switches, and then `proc_cr3' is its address space.
+ */
+TrapFrame *
+schedule(TrapFrame *tf) {
+	/* never switch inside the kernel */
+	if (tf->eip >= KOFFSET) {
+		return tf;
+	}
+
+	PCB *p = &pcb[cur];
+	p->tf = tf;
+	if (p->state == PROC_READY && !need_resched) {
+		return tf;
+	}
+	need_resched = false;
+
+	int i;
+	for (i = 1; i <= NR_PROC; i ++) {
+		int slot = (cur + i) % NR_PROC;
+		if (pcb[slot].state == PROC_READY) {
+			cur = slot;
+			proc_cr3 = get_ucr3();
+			return pcb[slot].tf;
+		}
+	}
+
+	for (i = 0; i < NR_PROC; i ++) {
+		if (pcb[i].state != PROC_UNUSED) {
+			panic("all processes are waiting");
+		}
+	}
+	finish();
+	return tf;
+}
+
+#ifdef HAS_DEVICE
+static void
+proc_tick(void) {
+	need_resched = true;
+}
+#endif
+
+/* Create a process for every program in the disk. The programs are put
+ * one after another, each starting at a sector boundary.
+ */
+void
+init_proc(void) {
+	uint32_t offset = 0, size;
+	while (pcb[NR_PROC - 1].state == PROC_UNUSED && (size = elf_size(offset)) != 0) {
+		int pid = proc_create(offset);
+		Log("process %d: the program at 0x%x in the disk", pid, offset);
+		offset = (offset + size + 511) & ~511;
+#ifndef HAS_DEVICE
+		/* the ramdisk only holds one program */
+		break;
+#endif
+	}
+	assert(pcb[0].state == PROC_READY);
+
+	/* the traps of programs mean exit(), instead of the end of NEMU */
+	nemu_set_trap_vector(TRAP_VECTOR, KOFFSET);
+#ifdef HAS_DEVICE
+	add_irq_handle(0, proc_tick);
+#endif
+
+	/* Report the free physical memory. */
+	buddy_stat();
+}
+
+/* Start running the first process. */
+void
+proc_run(void) {
+	void irq_switch(TrapFrame *);
+	cur = 0;
+	proc_cr3 = get_ucr3();
+	irq_switch(pcb[0].tf);
+}
+
+#else
+
+/* Without paging, there is only one process. */
+
+int proc_slot() { return 0; }
+
+TrapFrame *
+schedule(TrapFrame *tf) {
+	return tf;
+}
+
+#endif
@@ -2,8 +2,23 @@
 
 #include <sys/syscall.h>
 
-void add_irq_handle(int, void (*)(void));
+#define SYS_has_sysenter 1000
+
+void add_user_irq_handle(int, void (*)(void));
 void mm_brk(uint32_t);
+void pvcon_write(const char *, int);
+int pvcon_read(char *, int);
+
+int fs_open(const char *, int);
+int fs_read(int, void *, int);
+int fs_write(int, void *, int);
+int fs_lseek(int, int, int);
+int fs_close(int);
+int fs_extent(int, uint32_t *, uint32_t *);
+uint32_t mm_mmap(uint32_t, uint32_t, uint32_t, uint32_t);
+void mm_populate(uint32_t, uint32_t);
+void proc_exit(int);
+int proc_wait(int, uint32_t);
 
 static void sys_brk(TrapFrame *tf) {
 #ifdef IA32_PAGE
@@ -12,6 +27,88 @@ static void sys_brk(TrapFrame *tf) {
 	tf->eax = 0;
 }
 
+/* The standard streams are bound to the console, other descriptors are files. */
+static void sys_write(TrapFrame *tf) {
+	if(tf->ebx == 1 || tf->ebx == 2) {
+#ifdef HAS_DEVICE
+		pvcon_write((void *)tf->ecx, tf->edx);
+#endif
+		tf->eax = tf->edx;
+	}
+	else {
+#ifdef IA32_PAGE
+		mm_populate(tf->ecx, tf->edx);
+#endif
+		tf->eax = fs_write(tf->ebx, (void *)tf->ecx, tf->edx);
+	}
+}
+
+static void sys_read(TrapFrame *tf) {
+	if(tf->ebx == 0) {
+#ifdef HAS_DEVICE
+		tf->eax = pvcon_read((void *)tf->ecx, tf->edx);
+#else
+		tf->eax = 0;
+#endif
+	}
+	else {
+#ifdef IA32_PAGE
+		mm_populate(tf->ecx, tf->edx);
+#endif
+		tf->eax = fs_read(tf->ebx, (void *)tf->ecx, tf->edx);
+	}
+}
+
+static void sys_open(TrapFrame *tf) {
+	tf->eax = fs_open((void *)tf->ebx, tf->ecx);
+}
+
+static void sys_lseek(TrapFrame *tf) {
+	tf->eax = fs_lseek(tf->ebx, tf->ecx, tf->edx);
+}
+
+static void sys_close(TrapFrame *tf) {
+	tf->eax = fs_close(tf->ebx);
+}
+
+#define PROT_WRITE 0x2
+
+/* Only read-only mappings of files are supported. Like the old mmap()
+ * of i386 GNU/Linux, %ebx points to the arguments
+ * { addr, len, prot, flags, fd, offset }, and the address hint is ignored.
+ */
+static void sys_mmap(TrapFrame *tf) {
+	tf->eax = -1;
+#ifdef IA32_PAGE
+	uint32_t *args = (void *)tf->ebx;
+	uint32_t disk_offset, size;
+	if(!(args[2] & PROT_WRITE) && fs_extent(args[4], &disk_offset, &size) == 0) {
+		tf->eax = mm_mmap(args[1], disk_offset, size, args[5]);
+	}
+#endif
+}
+
+/* The process is switched out when it exits, see schedule(). Without
+ * paging, there is only one program, so its exit is the end of NEMU.
+ */
+static void sys_exit(TrapFrame *tf) {
+#ifdef IA32_PAGE
+	proc_exit(tf->ebx);
+#else
+	nemu_assert(tf->ebx == 0);
+	HIT_GOOD_TRAP;
+#endif
+}
+
+/* Only waitpid(pid, &status, 0) is supported, and the options are ignored. */
+static void sys_waitpid(TrapFrame *tf) {
+#ifdef IA32_PAGE
+	tf->eax = proc_wait(tf->ebx, tf->ecx);
+#else
+	tf->eax = -1;
+#endif
+}
+
 void do_syscall(TrapFrame *tf) {
 	switch(tf->eax) {
 		/* The ``add_irq_handle'' system call is artificial. We use it to 
@@ -21,11 +118,25 @@ void do_syscall(TrapFrame *tf) {
 		 */
 		case 0: 
 			cli();
-			add_irq_handle(tf->ebx, (void*)tf->ecx);
+			add_user_irq_handle(tf->ebx, (void*)tf->ecx);
 			sti();
 			break;
 
+		/* The artificial ``has_sysenter'' system call tells the user
+		 * program whether it can make system calls by ``sysenter''.
+		 * The MSRs are always set up along with the IDT.
+		 */
+		case SYS_has_sysenter: tf->eax = 1; break;
+
 		case SYS_brk: sys_brk(tf); break;
+		case SYS_write: sys_write(tf); break;
+		case SYS_read: sys_read(tf); break;
+		case SYS_open: sys_open(tf); break;
+		case SYS_lseek: sys_lseek(tf); break;
+		case SYS_close: sys_close(tf); break;
+		case SYS_mmap: sys_mmap(tf); break;
+		case SYS_exit: sys_exit(tf); break;
+		case SYS_waitpid: sys_waitpid(tf); break;
 
 		/* TODO: Add more system calls. */
 
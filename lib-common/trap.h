@@ -4,6 +4,19 @@
 #define concat_temp(x, y) x ## y
 #define concat(x, y) concat_temp(x, y)
 
+/* hypercall numbers, see nemu/src/monitor/hypercall.c */
+#define NEMU_HC_GOOD_TRAP 0
+#define NEMU_HC_BAD_TRAP  1
+#define NEMU_HC_NOP       2
+#define NEMU_HC_MEMCPY    3
+#define NEMU_HC_MEMSET    4
+#define NEMU_HC_FILE_READ 5
+#define NEMU_HC_TIME      6
+#define NEMU_HC_PERF_MARK 7
+#define NEMU_HC_PERF_BEGIN 8
+#define NEMU_HC_PERF_END  9
+#define NEMU_HC_TRAP_VECTOR 10
+
 #ifndef __ASSEMBLER__
 
 #define HIT_GOOD_TRAP \
@@ -22,6 +35,66 @@ set_bp(void) {
 	asm volatile ("int3");
 }
 
+/* Hypercalls. They only work when running under NEMU. */
+
+static __attribute__((always_inline)) inline void *
+nemu_memcpy(void *dst, const void *src, unsigned len) {
+	void *ret;
+	asm volatile (".byte 0xd6" : "=a" (ret)
+			: "a" (NEMU_HC_MEMCPY), "b" (dst), "c" (src), "d" (len) : "memory");
+	return ret;
+}
+
+static __attribute__((always_inline)) inline void *
+nemu_memset(void *dst, int c, unsigned len) {
+	void *ret;
+	asm volatile (".byte 0xd6" : "=a" (ret)
+			: "a" (NEMU_HC_MEMSET), "b" (dst), "c" (c), "d" (len) : "memory");
+	return ret;
+}
+
+/* Read at most `len' bytes at `offset' of the host file `path' into `buf'.
+ * Return the number of bytes read, or -1 on error.
+ */
+static __attribute__((always_inline)) inline int
+nemu_file_read(const char *path, void *buf, unsigned len, unsigned offset) {
+	int ret;
+	asm volatile (".byte 0xd6" : "=a" (ret)
+			: "a" (NEMU_HC_FILE_READ), "b" (path), "c" (buf), "d" (len), "S" (offset) : "memory");
+	return ret;
+}
+
+/* Deliver the good and bad traps at %eip below `limit' as interrupt
+ * `vector', with %eax kept, instead of stopping NEMU. A kernel uses it to
+ * learn that a program ends. A negative `vector' turns it off.
+ */
+static __attribute__((always_inline)) inline void
+nemu_set_trap_vector(int vector, unsigned limit) {
+	asm volatile (".byte 0xd6" : : "a" (NEMU_HC_TRAP_VECTOR), "b" (vector), "c" (limit));
+}
+
+/* monotonic time of the host in microseconds */
+static __attribute__((always_inline)) inline unsigned long long
+nemu_time(void) {
+	unsigned long long ret;
+	asm volatile (".byte 0xd6" : "=A" (ret) : "a" (NEMU_HC_TIME));
+	return ret;
+}
+
+static __attribute__((always_inline)) inline void
+nemu_perf_mark(int id) {
+	asm volatile (".byte 0xd6" : : "a" (NEMU_HC_PERF_MARK), "b" (id));
+}
+
+/* Bracket a region of code to measure its cost, which is reported by
+ * `info perf' in NEMU and when NEMU exits. `id' is in [0, 64).
+ */
+#define PERF_BEGIN(id) \
+	asm volatile(".byte 0xd6" : : "a" (NEMU_HC_PERF_BEGIN), "b" (id) : "memory")
+
+#define PERF_END(id) \
+	asm volatile(".byte 0xd6" : : "a" (NEMU_HC_PERF_END), "b" (id) : "memory")
+
 #else
 
 #define HIT_GOOD_TRAP \
@@ -34,4 +34,17 @@ typedef union CR3 {
 	uint32_t val;
 } CR3;
 
+/* the Control Register 4 */
+typedef union CR4 {
+	struct {
+		uint32_t virtual_8086        : 1;
+		uint32_t protected_virtual   : 1;
+		uint32_t time_stamp_disable  : 1;
+		uint32_t debugging_extension : 1;
+		uint32_t page_size_extension : 1;	/* 4MB pages in the page directory */
+		uint32_t pad0                : 27;
+	};
+	uint32_t val;
+} CR4;
+
 #endif
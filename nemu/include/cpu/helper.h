@@ -8,7 +8,8 @@
 #define make_helper(name) int name(swaddr_t eip)
 
 static inline uint32_t instr_fetch(swaddr_t addr, size_t len) {
-	return swaddr_read(addr, len);
+	/* not counted as a data access */
+	return lnaddr_read(addr, len);
 }
 
 /* Instruction Decode and EXecute */
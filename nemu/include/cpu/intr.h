@@ -0,0 +1,16 @@
+#ifndef __INTR_H__
+#define __INTR_H__
+
+#include "common.h"
+
+void enter_intr(uint8_t);
+void raise_intr(uint8_t);
+void raise_fault(uint8_t, uint32_t);
+
+/* the state at the beginning of the current instruction, which is
+ * restored when the instruction faults */
+extern swaddr_t instr_eip;
+extern uint32_t instr_esp;
+void idt_invalidate();
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __NATIVE_H__
+#define __NATIVE_H__
+
+#include "common.h"
+
+#define NR_NATIVE_SLOT 64
+
+/* Entry addresses of the hooked functions, indexed by the low bits of the
+ * address. A slot holding 0 is empty.
+ */
+extern swaddr_t native_entry[NR_NATIVE_SLOT];
+
+static inline bool is_native_entry(swaddr_t eip) {
+	return native_entry[eip % NR_NATIVE_SLOT] == eip && eip != 0;
+}
+
+void init_native();
+int native_call(swaddr_t);
+
+/* also used by the hypercalls */
+uint32_t native_memmove(uint32_t, uint32_t, uint32_t);
+uint32_t native_memset(uint32_t, uint32_t, uint32_t);
+uint32_t native_strlen(uint32_t, uint32_t, uint32_t);
+
+#endif
@@ -2,6 +2,7 @@
 #define __REG_H__
 
 #include "common.h"
+#include "../../../lib-common/x86-inc/cpu.h"
 
 enum { R_EAX, R_ECX, R_EDX, R_EBX, R_ESP, R_EBP, R_ESI, R_EDI };
 enum { R_AX, R_CX, R_DX, R_BX, R_SP, R_BP, R_SI, R_DI };
@@ -37,6 +38,44 @@ typedef struct {
 
 	swaddr_t eip;
 
+	union {
+		struct {
+			uint32_t CF		:1;
+			uint32_t		:1;
+			uint32_t PF		:1;
+			uint32_t		:1;
+			uint32_t AF		:1;
+			uint32_t		:1;
+			uint32_t ZF		:1;
+			uint32_t SF		:1;
+			uint32_t TF		:1;
+			uint32_t IF		:1;
+			uint32_t DF		:1;
+			uint32_t OF		:1;
+			uint32_t		:20;
+		};
+		uint32_t val;
+	} eflags;
+
+	/* Only the selector of CS is kept, to be saved in the interrupt frame. */
+	uint16_t cs;
+
+	struct {
+		uint16_t limit;
+		uint32_t base;
+	} idtr;
+
+	CR0 cr0;
+	uint32_t cr2;	/* the linear address of the last page fault */
+	CR3 cr3;
+	CR4 cr4;
+
+	/* the target of `sysenter', set by `wrmsr' */
+	uint32_t sysenter_cs, sysenter_esp, sysenter_eip;
+
+	/* the INTR pin, driven by the i8259 PIC */
+	bool INTR;
+
 } CPU_state;
 
 extern CPU_state cpu;
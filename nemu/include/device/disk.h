@@ -0,0 +1,11 @@
+#ifndef __DISK_H__
+#define __DISK_H__
+
+#include "common.h"
+
+void init_disk(const char *);
+size_t disk_capacity();
+void disk_read(void *, uint32_t, size_t);
+void disk_write(const void *, uint32_t, size_t);
+
+#endif
@@ -4,10 +4,16 @@
 #include "common.h"
 
 typedef void(*pio_callback_t)(ioaddr_t, size_t, bool);
+/* (port, data length, buffer, count, is_write), return the number of data transferred */
+typedef size_t(*pio_string_callback_t)(ioaddr_t, size_t, void *, size_t, bool);
 
 void* add_pio_map(ioaddr_t, size_t, pio_callback_t);
+void add_pio_string_handler(ioaddr_t, pio_string_callback_t);
+void add_pio_poll_port(ioaddr_t);
 
 uint32_t pio_read(ioaddr_t, size_t);
 void pio_write(ioaddr_t, size_t, uint32_t);
+void pio_read_string(ioaddr_t, size_t, void *, size_t);
+void pio_write_string(ioaddr_t, size_t, const void *, size_t);
 
 #endif
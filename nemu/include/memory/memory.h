@@ -2,11 +2,17 @@
 #define __MEMORY_H__
 
 #include "common.h"
+#include "../../../lib-common/x86-inc/mmu.h"
 
 #define HW_MEM_SIZE (128 * 1024 * 1024)
 
 extern uint8_t *hw_mem;
 
+/* the number of data accesses through swaddr_read() and swaddr_write() */
+extern uint64_t mem_read_count, mem_write_count;
+/* the number of misses in the TLB */
+extern uint64_t tlb_miss_count;
+
 /* convert the hardware address in the test program to virtual address in NEMU */
 #define hwa_to_va(p) ((void *)(hw_mem + (unsigned)p))
 /* convert the virtual address in NEMU to hardware address in the test program */
@@ -24,4 +30,11 @@ void swaddr_write(swaddr_t, size_t, uint32_t);
 void lnaddr_write(lnaddr_t, size_t, uint32_t);
 void hwaddr_write(hwaddr_t, size_t, uint32_t);
 
+void* swaddr_host_ptr(swaddr_t, size_t, bool);
+void tlb_flush();
+void swaddr_read_buf(swaddr_t, void *, size_t);
+void swaddr_write_buf(swaddr_t, const void *, size_t);
+
+void dram_invalidate(hwaddr_t, size_t);
+
 #endif
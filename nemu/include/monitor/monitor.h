@@ -1,7 +1,17 @@
 #ifndef __MONITOR_H__
 #define __MONITOR_H__
 
+#include "common.h"
+
 enum { STOP, RUNNING, END };
 extern int nemu_state;
 
+/* the number of instructions executed so far, which is also the
+ * virtual time seen by devices */
+extern uint64_t instr_count;
+
+/* the number of taken branches, i.e. instructions after which the control
+ * does not fall through to the next instruction */
+extern uint64_t branch_count;
+
 #endif
@@ -21,6 +21,11 @@
 #include "logic/shrd.h"
 
 #include "string/rep.h"
+#include "string/ins.h"
+#include "string/outs.h"
+
+#include "io/in.h"
+#include "io/out.h"
 
 #include "misc/misc.h"
 
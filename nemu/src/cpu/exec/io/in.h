@@ -0,0 +1,10 @@
+#ifndef __IN_H__
+#define __IN_H__
+
+make_helper(in_i2a_b);
+make_helper(in_d2a_b);
+
+make_helper(in_i2a_v);
+make_helper(in_d2a_v);
+
+#endif
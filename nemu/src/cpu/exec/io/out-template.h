@@ -0,0 +1,20 @@
+#include "cpu/exec/template-start.h"
+
+#define instr out
+
+make_helper(concat(out_a2i_, SUFFIX)) {
+	ioaddr_t port = instr_fetch(eip + 1, 1);
+	pio_write(port, DATA_BYTE, REG(R_EAX));
+
+	print_asm("out" str(SUFFIX) " %%%s,$0x%x", REG_NAME(R_EAX), port);
+	return 2;
+}
+
+make_helper(concat(out_a2d_, SUFFIX)) {
+	pio_write(reg_w(R_DX), DATA_BYTE, REG(R_EAX));
+
+	print_asm("out" str(SUFFIX) " %%%s,(%%dx)", REG_NAME(R_EAX));
+	return 1;
+}
+
+#include "cpu/exec/template-end.h"
@@ -1,5 +1,7 @@
 #include "cpu/exec/helper.h"
 #include "cpu/decode/modrm.h"
+#include "monitor/monitor.h"
+#include "cpu/intr.h"
 
 make_helper(nop) {
 	print_asm("nop");
@@ -23,3 +25,241 @@ make_helper(lea) {
 	print_asm("leal %s,%%%s", op_src->str, regsl[m.reg]);
 	return 1 + len;
 }
+
+make_helper(hlt) {
+	print_asm("hlt");
+
+#ifdef HAS_DEVICE
+	if(cpu.eflags.IF) {
+		/* Instead of spinning until the next interrupt arrives, let
+		 * the devices fast-forward to their next event. */
+		void device_idle();
+		while(!cpu.INTR && nemu_state == RUNNING) {
+			device_idle();
+		}
+		return 1;
+	}
+#endif
+
+	/* Nothing can wake the CPU up any more. */
+	printf("\33[1;31mnemu: hlt with no interrupt to wait for\33[0m at eip = 0x%08x\n\n", eip);
+	nemu_state = END;
+	return 1;
+}
+
+make_helper(cli) {
+	cpu.eflags.IF = 0;
+	print_asm("cli");
+	return 1;
+}
+
+make_helper(sti) {
+	cpu.eflags.IF = 1;
+	print_asm("sti");
+	return 1;
+}
+
+make_helper(cld) {
+	cpu.eflags.DF = 0;
+	print_asm("cld");
+	return 1;
+}
+
+make_helper(std) {
+	cpu.eflags.DF = 1;
+	print_asm("std");
+	return 1;
+}
+
+make_helper(int_i) {
+	uint8_t NO = instr_fetch(eip + 1, 1);
+	print_asm("int $0x%x", NO);
+
+	extern bool user_mode;
+	if(user_mode && NO == 0x80) {
+		void do_user_syscall();
+		do_user_syscall();
+		return 2;
+	}
+
+	/* the handler returns to the next instruction */
+	cpu.eip += 2;
+	raise_intr(NO);
+
+	/* should not reach here */
+	return 0;
+}
+
+static inline uint32_t pop() {
+	uint32_t val = swaddr_read(cpu.esp, 4);
+	cpu.esp += 4;
+	return val;
+}
+
+make_helper(iret) {
+	cpu.eip = pop();
+	cpu.cs = pop();
+	cpu.eflags.val = pop();
+
+	print_asm("iret");
+
+	/* cpu.eip is updated by the length of this instruction after it returns */
+	cpu.eip --;
+	return 1;
+}
+
+make_helper(lidt) {
+	ModR_M m;
+	m.val = instr_fetch(eip + 1, 1);
+	int len = load_addr(eip + 1, &m, op_src);
+	cpu.idtr.limit = lnaddr_read(op_src->addr, 2);
+	cpu.idtr.base = lnaddr_read(op_src->addr + 2, 4);
+	idt_invalidate();
+
+	print_asm("lidt %s", op_src->str);
+	return 1 + len;
+}
+
+/* Performance counters, read by `rdpmc' with the index in %ecx, or by
+ * `rdmsr' at IA32_PMC0 + index. The time stamp counter advances by one
+ * for every instruction executed, so it is the same as counter 0.
+ */
+#define MSR_TSC  0x10
+#define MSR_PMC0 0xc1
+
+enum { PMC_INSTR, PMC_MEM_READ, PMC_MEM_WRITE, PMC_BRANCH, PMC_TLB_MISS, NR_PMC };
+
+static bool read_pmc(uint32_t idx, uint64_t *val) {
+	switch(idx) {
+		case PMC_INSTR: *val = instr_count; break;
+		case PMC_MEM_READ: *val = mem_read_count; break;
+		case PMC_MEM_WRITE: *val = mem_write_count; break;
+		case PMC_BRANCH: *val = branch_count; break;
+		case PMC_TLB_MISS: *val = tlb_miss_count; break;
+		default: return false;
+	}
+	return true;
+}
+
+static inline void set_edx_eax(uint64_t val) {
+	cpu.eax = (uint32_t)val;
+	cpu.edx = (uint32_t)(val >> 32);
+}
+
+make_helper(rdtsc) {
+	set_edx_eax(instr_count);
+	print_asm("rdtsc");
+	return 1;
+}
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+static uint32_t* sysenter_msr(uint32_t idx) {
+	switch(idx) {
+		case MSR_SYSENTER_CS: return &cpu.sysenter_cs;
+		case MSR_SYSENTER_ESP: return &cpu.sysenter_esp;
+		case MSR_SYSENTER_EIP: return &cpu.sysenter_eip;
+		default: return NULL;
+	}
+}
+
+make_helper(rdmsr) {
+	uint64_t val;
+	uint32_t *msr = sysenter_msr(cpu.ecx);
+	print_asm("rdmsr");
+	if(cpu.ecx == MSR_TSC) { val = instr_count; }
+	else if(msr) { val = *msr; }
+	else if(cpu.ecx < MSR_PMC0 || !read_pmc(cpu.ecx - MSR_PMC0, &val)) {
+		/* general protection fault */
+		raise_fault(13, 0);
+	}
+	set_edx_eax(val);
+	return 1;
+}
+
+/* Only the MSRs of `sysenter' are writable. */
+make_helper(wrmsr) {
+	uint32_t *msr = sysenter_msr(cpu.ecx);
+	print_asm("wrmsr");
+	if(msr == NULL) {
+		raise_fault(13, 0);
+	}
+	*msr = cpu.eax;
+	return 1;
+}
+
+make_helper(rdpmc) {
+	uint64_t val;
+	print_asm("rdpmc");
+	if(!read_pmc(cpu.ecx, &val)) {
+		/* general protection fault */
+		raise_fault(13, 0);
+	}
+	set_edx_eax(val);
+	return 1;
+}
+
+/* mov between control registers and general registers, whose ModR/M byte
+ * always selects registers */
+static uint32_t* get_cr(int idx) {
+	switch(idx) {
+		case 0: return &cpu.cr0.val;
+		case 2: return &cpu.cr2;
+		case 3: return &cpu.cr3.val;
+		case 4: return &cpu.cr4.val;
+		default: raise_fault(6, 0); return NULL;
+	}
+}
+
+make_helper(mov_cr2r) {
+	ModR_M m;
+	m.val = instr_fetch(eip + 1, 1);
+	reg_l(m.R_M) = *get_cr(m.reg);
+	print_asm("movl %%cr%d,%%%s", m.reg, regsl[m.R_M]);
+	return 2;
+}
+
+make_helper(mov_r2cr) {
+	ModR_M m;
+	m.val = instr_fetch(eip + 1, 1);
+	*get_cr(m.reg) = reg_l(m.R_M);
+	if(m.reg != 2) {
+		/* the translations in TLB are out of date */
+		tlb_flush();
+	}
+	print_asm("movl %%%s,%%cr%d", regsl[m.R_M], m.reg);
+	return 2;
+}
+
+/* Fast system calls. `sysenter' jumps to the entry set in the MSRs with
+ * interrupts disabled, and `sysexit' returns to %edx with the stack at %ecx.
+ * The data segments are flat, so only the selector of CS is changed.
+ */
+make_helper(sysenter) {
+	print_asm("sysenter");
+	if((cpu.sysenter_cs & ~0x3) == 0) {
+		raise_fault(13, 0);
+	}
+	cpu.eflags.IF = 0;
+	cpu.cs = cpu.sysenter_cs & ~0x3;
+	cpu.esp = cpu.sysenter_esp;
+
+	/* cpu.eip is updated by the length of this instruction after it returns */
+	cpu.eip = cpu.sysenter_eip - 2;
+	return 1;
+}
+
+make_helper(sysexit) {
+	print_asm("sysexit");
+	if((cpu.sysenter_cs & ~0x3) == 0) {
+		raise_fault(13, 0);
+	}
+	/* like the processor, return to ring 3 with the code segment two
+	 * descriptors after SYSENTER_CS, which the GDT must provide */
+	cpu.cs = (cpu.sysenter_cs + 16) | 0x3;
+	cpu.esp = cpu.ecx;
+	cpu.eip = cpu.edx - 2;
+	return 1;
+}
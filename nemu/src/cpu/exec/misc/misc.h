@@ -4,5 +4,21 @@
 make_helper(nop);
 make_helper(int3);
 make_helper(lea);
+make_helper(hlt);
+make_helper(cli);
+make_helper(sti);
+make_helper(cld);
+make_helper(std);
+make_helper(int_i);
+make_helper(iret);
+make_helper(lidt);
+make_helper(rdtsc);
+make_helper(rdmsr);
+make_helper(wrmsr);
+make_helper(rdpmc);
+make_helper(mov_cr2r);
+make_helper(mov_r2cr);
+make_helper(sysenter);
+make_helper(sysexit);
 
 #endif
@@ -27,16 +27,8 @@ make_helper(inv) {
 make_helper(nemu_trap) {
 	print_asm("nemu trap (eax = %d)", cpu.eax);
 
-	switch(cpu.eax) {
-		case 2:
-		   	break;
-
-		default:
-			printf("\33[1;31mnemu: HIT %s TRAP\33[0m at eip = 0x%08x\n\n",
-					(cpu.eax == 0 ? "GOOD" : "BAD"), cpu.eip);
-			nemu_state = END;
-	}
+	void do_hypercall();
+	do_hypercall();
 
 	return 1;
 }
-
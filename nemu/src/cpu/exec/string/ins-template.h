@@ -0,0 +1,47 @@
+#include "cpu/exec/template-start.h"
+
+#define instr ins
+
+make_helper(concat(ins_, SUFFIX)) {
+	ioaddr_t port = reg_w(R_DX);
+	int step = (cpu.eflags.DF ? -DATA_BYTE : DATA_BYTE);
+
+	if(ops_decoded.is_rep && !cpu.eflags.DF) {
+		/* Let the device fill a whole block of memory in one shot. A block
+		 * never crosses a page boundary, so it is contiguous in physical memory. */
+		while(cpu.ecx) {
+			uint32_t n = (PAGE_SIZE - (cpu.edi & PAGE_MASK)) / DATA_BYTE;
+			if(n == 0) {
+				/* the datum crosses the page boundary */
+				MEM_W(cpu.edi, pio_read(port, DATA_BYTE));
+				n = 1;
+			}
+			else {
+				if(n > cpu.ecx) { n = cpu.ecx; }
+				void *buf = swaddr_host_ptr(cpu.edi, n * DATA_BYTE, true);
+				if(buf) { pio_read_string(port, DATA_BYTE, buf, n); }
+				else {
+					MEM_W(cpu.edi, pio_read(port, DATA_BYTE));
+					n = 1;
+				}
+			}
+			cpu.edi += n * DATA_BYTE;
+			cpu.ecx -= n;
+		}
+	}
+	else if(ops_decoded.is_rep) {
+		for(; cpu.ecx; cpu.ecx --) {
+			MEM_W(cpu.edi, pio_read(port, DATA_BYTE));
+			cpu.edi += step;
+		}
+	}
+	else {
+		MEM_W(cpu.edi, pio_read(port, DATA_BYTE));
+		cpu.edi += step;
+	}
+
+	print_asm("ins" str(SUFFIX) " (%%dx),%%es:(%%edi)");
+	return 1;
+}
+
+#include "cpu/exec/template-end.h"
@@ -0,0 +1,8 @@
+#ifndef __INS_H__
+#define __INS_H__
+
+make_helper(ins_b);
+
+make_helper(ins_v);
+
+#endif
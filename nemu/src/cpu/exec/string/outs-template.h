@@ -0,0 +1,45 @@
+#include "cpu/exec/template-start.h"
+
+#define instr outs
+
+make_helper(concat(outs_, SUFFIX)) {
+	ioaddr_t port = reg_w(R_DX);
+	int step = (cpu.eflags.DF ? -DATA_BYTE : DATA_BYTE);
+
+	if(ops_decoded.is_rep && !cpu.eflags.DF) {
+		/* Let the device consume a whole block of memory in one shot. */
+		while(cpu.ecx) {
+			uint32_t n = (PAGE_SIZE - (cpu.esi & PAGE_MASK)) / DATA_BYTE;
+			if(n == 0) {
+				pio_write(port, DATA_BYTE, MEM_R(cpu.esi));
+				n = 1;
+			}
+			else {
+				if(n > cpu.ecx) { n = cpu.ecx; }
+				void *buf = swaddr_host_ptr(cpu.esi, n * DATA_BYTE, false);
+				if(buf) { pio_write_string(port, DATA_BYTE, buf, n); }
+				else {
+					pio_write(port, DATA_BYTE, MEM_R(cpu.esi));
+					n = 1;
+				}
+			}
+			cpu.esi += n * DATA_BYTE;
+			cpu.ecx -= n;
+		}
+	}
+	else if(ops_decoded.is_rep) {
+		for(; cpu.ecx; cpu.ecx --) {
+			pio_write(port, DATA_BYTE, MEM_R(cpu.esi));
+			cpu.esi += step;
+		}
+	}
+	else {
+		pio_write(port, DATA_BYTE, MEM_R(cpu.esi));
+		cpu.esi += step;
+	}
+
+	print_asm("outs" str(SUFFIX) " %%ds:(%%esi),(%%dx)");
+	return 1;
+}
+
+#include "cpu/exec/template-end.h"
@@ -0,0 +1,19 @@
+#include "cpu/exec/helper.h"
+#include "memory/memory.h"
+#include "device/port-io.h"
+
+#define DATA_BYTE 1
+#include "outs-template.h"
+#undef DATA_BYTE
+
+#define DATA_BYTE 2
+#include "outs-template.h"
+#undef DATA_BYTE
+
+#define DATA_BYTE 4
+#include "outs-template.h"
+#undef DATA_BYTE
+
+/* for instruction encoding overloading */
+
+make_helper_v(outs)
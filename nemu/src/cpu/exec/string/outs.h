@@ -0,0 +1,8 @@
+#ifndef __OUTS_H__
+#define __OUTS_H__
+
+make_helper(outs_b);
+
+make_helper(outs_v);
+
+#endif
@@ -5,11 +5,24 @@ make_helper(exec);
 make_helper(rep) {
 	int len;
 	int count = 0;
-	if(instr_fetch(eip + 1, 1) == 0xc3) {
+	uint32_t opcode = instr_fetch(eip + 1, 1);
+	if(opcode == 0x66) {
+		opcode = instr_fetch(eip + 2, 1);
+	}
+
+	if(opcode == 0xc3) {
 		/* repz ret */
 		exec(eip + 1);
 		len = 0;
 	}
+	else if(opcode >= 0x6c && opcode <= 0x6f) {
+		/* ins/outs repeat by themselves, so that the device
+		 * can transfer a whole block of data in one shot */
+		count = cpu.ecx;
+		ops_decoded.is_rep = true;
+		len = exec(eip + 1);
+		ops_decoded.is_rep = false;
+	}
 	else {
 		while(cpu.ecx) {
 			exec(eip + 1);
@@ -0,0 +1,88 @@
+#include "nemu.h"
+#include "cpu/intr.h"
+
+#include <setjmp.h>
+
+extern jmp_buf jbuf;
+
+/* Gate descriptors decoded from the IDT in guest memory. An entry is only
+ * valid if its generation matches `idt_generation', which is bumped by
+ * `lidt' and by any write into the IDT, so invalidating the whole cache
+ * costs nothing.
+ */
+typedef struct {
+	uint32_t generation;
+	bool is_trap;
+	swaddr_t offset;
+} GateCache;
+
+static GateCache gate_cache[256];
+static uint32_t idt_generation = 1;
+
+void idt_invalidate() {
+	idt_generation ++;
+}
+
+static GateCache* get_gate(uint8_t NO) {
+	GateCache *g = &gate_cache[NO];
+	if(g->generation != idt_generation) {
+		Assert((NO << 3) + 7 <= cpu.idtr.limit, "interrupt #%d is beyond the limit of IDT", NO);
+		lnaddr_t addr = cpu.idtr.base + (NO << 3);
+		uint32_t lo = lnaddr_read(addr, 4);
+		uint32_t hi = lnaddr_read(addr + 4, 4);
+		Assert(hi & 0x8000, "the gate descriptor of interrupt #%d is not present", NO);
+
+		g->offset = (hi & 0xffff0000) | (lo & 0xffff);
+		g->is_trap = (hi >> 8) & 0x1;	/* type 0xf: trap gate, type 0xe: interrupt gate */
+		g->generation = idt_generation;
+	}
+	return g;
+}
+
+static inline void push(uint32_t val) {
+	cpu.esp -= 4;
+	swaddr_write(cpu.esp, 4, val);
+}
+
+/* Enter the handler of interrupt `NO'. The address of the next
+ * instruction to execute after the handler returns is `cpu.eip'.
+ */
+void enter_intr(uint8_t NO) {
+	GateCache *g = get_gate(NO);
+
+	push(cpu.eflags.val);
+	push(cpu.cs);
+	push(cpu.eip);
+
+	if(!g->is_trap) {
+		cpu.eflags.IF = 0;
+	}
+	cpu.eip = g->offset;
+}
+
+/* Raise interrupt `NO' inside an instruction, e.g. `int' or an exception.
+ * The rest of the instruction is abandoned.
+ */
+void raise_intr(uint8_t NO) {
+	enter_intr(NO);
+	longjmp(jbuf, 1);
+}
+
+/* Raise exception `NO', which pushes `error_code', inside an instruction.
+ * The state at the beginning of the instruction is restored, so that the
+ * instruction is restarted after the handler returns.
+ */
+void raise_fault(uint8_t NO, uint32_t error_code) {
+	static bool delivering = false;
+	Assert(!delivering, "exception #%d while delivering another one at eip = 0x%08x", NO, instr_eip);
+
+	cpu.eip = instr_eip;
+	cpu.esp = instr_esp;
+
+	delivering = true;
+	enter_intr(NO);
+	push(error_code);
+	delivering = false;
+
+	longjmp(jbuf, 1);
+}
@@ -0,0 +1,210 @@
+#include "nemu.h"
+#include "cpu/native.h"
+
+/* Native replacements of hot functions in the C library of the guest.
+ * When the program is about to enter one of the functions listed by the
+ * `-n' option (a comma-separated list of names, or `all'), NEMU performs
+ * the function on the host instead and returns to the caller, as if the
+ * guest had executed the `ret' instruction of the function itself.
+ *
+ * The functions follow the cdecl calling convention: the arguments are at
+ * 4(%esp), 8(%esp), ..., and the result is returned in %eax. Like the
+ * assembly version in newlib, only %eax, %ecx and %edx may be changed, and
+ * these functions leave %ecx and %edx untouched. Guest memory is accessed
+ * through swaddr_read_buf() and swaddr_write_buf(), after checking that
+ * every page to access is present (see check_range()).
+ */
+char *native_list = NULL;
+
+swaddr_t find_func_symbol(const char *);
+
+static uint32_t native_memcpy(uint32_t, uint32_t, uint32_t);
+static uint32_t native_strcmp(uint32_t, uint32_t, uint32_t);
+
+static struct {
+	const char *name;
+	uint32_t (*func)(uint32_t, uint32_t, uint32_t);
+} native_table[] = {
+	{ "memcpy", native_memcpy },
+	{ "memmove", native_memmove },
+	{ "memset", native_memset },
+	{ "strlen", native_strlen },
+	{ "strcmp", native_strcmp },
+};
+
+#define NR_NATIVE (sizeof(native_table) / sizeof(native_table[0]))
+
+swaddr_t native_entry[NR_NATIVE_SLOT];
+static int native_idx[NR_NATIVE_SLOT];
+
+/* the number of bytes from `addr' to the end of its page, at most `len' */
+static inline size_t page_chunk(swaddr_t addr, size_t len) {
+	size_t n = PAGE_SIZE - (addr & PAGE_MASK);
+	return (n < len ? n : len);
+}
+
+/* Touch every page of [addr, addr + len) with swaddr_host_ptr(), which
+ * raises the page fault of the first page not accessible. A function which
+ * modifies the guest memory checks all its ranges first, so that it either
+ * completes or faults before writing anything, and the guest can restart it
+ * after serving the fault.
+ */
+static void check_range(swaddr_t addr, uint32_t len, bool is_write) {
+	uint32_t off = 0;
+	while(off < len) {
+		size_t n = page_chunk(addr + off, len - off);
+		swaddr_host_ptr(addr + off, n, is_write);
+		off += n;
+	}
+}
+
+uint32_t native_memmove(uint32_t dst, uint32_t src, uint32_t len) {
+	uint8_t buf[PAGE_SIZE];
+	check_range(src, len, false);
+	check_range(dst, len, true);
+	if(dst <= src || dst - src >= len) {
+		/* copy forward */
+		uint32_t off;
+		for(off = 0; off < len; off += PAGE_SIZE) {
+			uint32_t n = (len - off < PAGE_SIZE ? len - off : PAGE_SIZE);
+			swaddr_read_buf(src + off, buf, n);
+			swaddr_write_buf(dst + off, buf, n);
+		}
+	}
+	else {
+		/* the destination overlaps the end of the source, copy backward */
+		uint32_t end = len;
+		while(end > 0) {
+			uint32_t n = (end < PAGE_SIZE ? end : PAGE_SIZE);
+			end -= n;
+			swaddr_read_buf(src + end, buf, n);
+			swaddr_write_buf(dst + end, buf, n);
+		}
+	}
+	return dst;
+}
+
+static uint32_t native_memcpy(uint32_t dst, uint32_t src, uint32_t len) {
+	/* overlapping is undefined for memcpy(), so any order is right */
+	return native_memmove(dst, src, len);
+}
+
+uint32_t native_memset(uint32_t s, uint32_t c, uint32_t len) {
+	uint8_t buf[PAGE_SIZE];
+	memset(buf, c & 0xff, (len < PAGE_SIZE ? len : PAGE_SIZE));
+	check_range(s, len, true);
+
+	uint32_t off = 0;
+	while(off < len) {
+		uint32_t n = page_chunk(s + off, len - off);
+		swaddr_write_buf(s + off, buf, n);
+		off += n;
+	}
+	return s;
+}
+
+uint32_t native_strlen(uint32_t s, uint32_t unused1, uint32_t unused2) {
+	uint32_t len = 0;
+	while(true) {
+		size_t n = page_chunk(s + len, PAGE_SIZE);
+		const uint8_t *p = swaddr_host_ptr(s + len, n, false);
+		if(p) {
+			const uint8_t *end = memchr(p, '\0', n);
+			if(end) { return len + (end - p); }
+			len += n;
+		}
+		else {
+			if(swaddr_read(s + len, 1) == 0) { return len; }
+			len ++;
+		}
+	}
+}
+
+static uint32_t native_strcmp(uint32_t s1, uint32_t s2, uint32_t unused) {
+	while(true) {
+		/* compare up to the nearer page boundary of the two strings */
+		size_t i, n = page_chunk(s1, page_chunk(s2, PAGE_SIZE));
+		const uint8_t *p1 = swaddr_host_ptr(s1, n, false);
+		const uint8_t *p2 = swaddr_host_ptr(s2, n, false);
+		for(i = 0; i < n; i ++) {
+			uint8_t c1 = (p1 ? p1[i] : swaddr_read(s1 + i, 1));
+			uint8_t c2 = (p2 ? p2[i] : swaddr_read(s2 + i, 1));
+			if(c1 != c2 || c1 == '\0') {
+				/* the same result as newlib */
+				return (int)c1 - (int)c2;
+			}
+		}
+		s1 += n;
+		s2 += n;
+	}
+}
+
+static bool is_listed(const char *name) {
+	if(strcmp(native_list, "all") == 0) {
+		return true;
+	}
+
+	size_t len = strlen(name);
+	const char *p = native_list;
+	while(true) {
+		const char *end = strchr(p, ',');
+		size_t n = (end ? end - p : strlen(p));
+		if(n == len && strncmp(p, name, len) == 0) {
+			return true;
+		}
+		if(end == NULL) {
+			return false;
+		}
+		p = end + 1;
+	}
+}
+
+/* Look up the functions to replace in the symbol table of the program. */
+void init_native() {
+	memset(native_entry, 0, sizeof(native_entry));
+	if(native_list == NULL) {
+		return;
+	}
+
+	int i;
+	for(i = 0; i < NR_NATIVE; i ++) {
+		if(!is_listed(native_table[i].name)) {
+			continue;
+		}
+
+		swaddr_t addr = find_func_symbol(native_table[i].name);
+		if(addr == 0) {
+			Log("native %s: not found in the program", native_table[i].name);
+			continue;
+		}
+
+		int slot = addr % NR_NATIVE_SLOT;
+		if(native_entry[slot] != 0) {
+			Log("native %s: conflicts with %s, ignored", native_table[i].name, native_table[native_idx[slot]].name);
+			continue;
+		}
+		native_entry[slot] = addr;
+		native_idx[slot] = i;
+		Log("native %s at 0x%08x", native_table[i].name, addr);
+	}
+}
+
+/* Perform the function whose entry is `eip' and return to the caller.
+ * Return the length to add to `cpu.eip', which is always 0.
+ */
+int native_call(swaddr_t eip) {
+	int i = native_idx[eip % NR_NATIVE_SLOT];
+	uint32_t arg1 = swaddr_read(cpu.esp + 4, 4);
+	uint32_t arg2 = swaddr_read(cpu.esp + 8, 4);
+	uint32_t arg3 = swaddr_read(cpu.esp + 12, 4);
+
+	cpu.eax = native_table[i].func(arg1, arg2, arg3);
+
+	/* ret */
+	cpu.eip = swaddr_read(cpu.esp, 4);
+	cpu.esp += 4;
+
+	extern char assembly[];
+	sprintf(assembly, "native %s(0x%x, 0x%x, 0x%x)", native_table[i].name, arg1, arg2, arg3);
+	return 0;
+}
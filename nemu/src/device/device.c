@@ -6,6 +6,8 @@ void init_timer();
 void init_vga();
 void init_i8042();
 void init_ide();
+void init_pvblk();
+void init_pvcon();
 
 void init_device() {
 	init_serial();
@@ -13,6 +15,8 @@ void init_device() {
 	init_vga();
 	init_i8042();
 	init_ide();
+	init_pvblk();
+	init_pvcon();
 }
 
 #endif
@@ -0,0 +1,234 @@
+#include "common.h"
+#include "device/disk.h"
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* The backing store of the IDE disk.
+ *
+ * Without an overlay, the disk image is mapped read-write and guest writes
+ * go straight into it. With an overlay, the image is only used as a read-only
+ * base, and every block written by the guest is first copied into a per-run
+ * delta file (copy-on-write). Therefore several NEMU instances can share the
+ * same base image, and restarting from a clean disk is simply deleting the
+ * delta file.
+ *
+ * Layout of the delta file:
+ *
+ *   +--------+------------------------+-------------------------------+
+ *   | header | map[nr_block] (uint32) | data blocks, BLOCK_SIZE each  |
+ *   +--------+------------------------+-------------------------------+
+ *   0                                 data_off
+ *
+ * map[i] is 0 if block i of the disk still lives in the base image,
+ * otherwise the data of block i is stored in data block (map[i] - 1).
+ * Data blocks are allocated in the order they are first written, so the
+ * file only grows with the amount of data the guest writes.
+ */
+
+#define BLOCK_SIZE 4096
+#define OVERLAY_MAGIC "NEMU-COW"
+
+typedef struct {
+	char magic[8];
+	uint32_t block_size;
+	uint32_t nr_block;
+	uint32_t nr_alloc;
+	uint32_t base_size;
+} overlay_header;
+
+/* the name of the delta file, set by the `-o' option */
+char *overlay_file = NULL;
+/* commit the delta file into the base image at exit, set by the `-C' option */
+bool overlay_commit = false;
+
+static uint8_t *base;
+static size_t disk_size;
+
+static int overlay_fd;
+static uint8_t *overlay;
+static overlay_header *hdr;
+static uint32_t *map;
+static size_t data_off;
+
+/* The disk is used by both the CPU thread (PIO, pvblk, rep ins/outs) and
+ * the DMA I/O thread, and copy on write changes the overlay, so every
+ * access holds this lock. */
+static pthread_mutex_t disk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define block_data(slot) (overlay + data_off + (size_t)(slot) * BLOCK_SIZE)
+
+static inline uint8_t* block_read_ptr(uint32_t block) {
+	if(overlay == NULL || map[block] == 0) {
+		return base + (size_t)block * BLOCK_SIZE;
+	}
+	return block_data(map[block] - 1);
+}
+
+static uint8_t* block_write_ptr(uint32_t block) {
+	if(overlay == NULL) {
+		return base + (size_t)block * BLOCK_SIZE;
+	}
+
+	if(map[block] == 0) {
+		/* copy on write: allocate a data block in the delta file */
+		uint32_t slot = hdr->nr_alloc;
+		int ret = ftruncate(overlay_fd, data_off + (size_t)(slot + 1) * BLOCK_SIZE);
+		Assert(ret == 0, "Can not grow '%s'", overlay_file);
+
+		size_t offset = (size_t)block * BLOCK_SIZE;
+		size_t len = (disk_size - offset < BLOCK_SIZE ? disk_size - offset : BLOCK_SIZE);
+		memcpy(block_data(slot), base + offset, len);
+
+		hdr->nr_alloc ++;
+		map[block] = slot + 1;
+	}
+	return block_data(map[block] - 1);
+}
+
+size_t disk_capacity() {
+	return disk_size;
+}
+
+void disk_read(void *buf, uint32_t offset, size_t len) {
+	pthread_mutex_lock(&disk_lock);
+	uint8_t *p = buf;
+	while(len > 0 && offset < disk_size) {
+		uint32_t block_offset = offset % BLOCK_SIZE;
+		size_t n = BLOCK_SIZE - block_offset;
+		if(n > len) { n = len; }
+		if(n > disk_size - offset) { n = disk_size - offset; }
+
+		memcpy(p, block_read_ptr(offset / BLOCK_SIZE) + block_offset, n);
+		p += n;
+		offset += n;
+		len -= n;
+	}
+
+	/* The part beyond the end of the disk image reads as zero. */
+	memset(p, 0, len);
+	pthread_mutex_unlock(&disk_lock);
+}
+
+void disk_write(const void *buf, uint32_t offset, size_t len) {
+	Assert(offset + len <= disk_size, "write beyond the end of disk (offset = 0x%x)", offset);
+
+	pthread_mutex_lock(&disk_lock);
+	const uint8_t *p = buf;
+	while(len > 0) {
+		uint32_t block_offset = offset % BLOCK_SIZE;
+		size_t n = BLOCK_SIZE - block_offset;
+		if(n > len) { n = len; }
+
+		memcpy(block_write_ptr(offset / BLOCK_SIZE) + block_offset, p, n);
+		p += n;
+		offset += n;
+		len -= n;
+	}
+	pthread_mutex_unlock(&disk_lock);
+}
+
+/* Write the data blocks in the delta file back into the base image,
+ * and then reset the delta file to be empty.
+ */
+static void disk_commit(const char *image) {
+	int fd = open(image, O_WRONLY);
+	Assert(fd >= 0, "Can not open '%s' for commit", image);
+
+	uint32_t i, nr_commit = 0;
+	for(i = 0; i < hdr->nr_block; i ++) {
+		if(map[i] != 0) {
+			size_t offset = (size_t)i * BLOCK_SIZE;
+			size_t len = (disk_size - offset < BLOCK_SIZE ? disk_size - offset : BLOCK_SIZE);
+			ssize_t ret = pwrite(fd, block_data(map[i] - 1), len, offset);
+			Assert(ret == len, "Can not commit block %d", i);
+			map[i] = 0;
+			nr_commit ++;
+		}
+	}
+	close(fd);
+
+	hdr->nr_alloc = 0;
+	int ret = ftruncate(overlay_fd, data_off);
+	assert(ret == 0);
+
+	Log("commit %d blocks from '%s' into '%s'", nr_commit, overlay_file, image);
+}
+
+static const char *image_file;
+
+static void disk_commit_at_exit() {
+	/* wait for the DMA request in flight */
+	pthread_mutex_lock(&disk_lock);
+	disk_commit(image_file);
+	pthread_mutex_unlock(&disk_lock);
+}
+
+static void init_overlay() {
+	uint32_t nr_block = (disk_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	data_off = (sizeof(overlay_header) + nr_block * sizeof(uint32_t) + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+
+	overlay_fd = open(overlay_file, O_RDWR | O_CREAT, 0644);
+	Assert(overlay_fd >= 0, "Can not open '%s'", overlay_file);
+
+	struct stat st;
+	int ret = fstat(overlay_fd, &st);
+	assert(ret == 0);
+
+	bool is_new = (st.st_size == 0);
+	if(is_new) {
+		ret = ftruncate(overlay_fd, data_off);
+		assert(ret == 0);
+	}
+
+	/* Reserve the address space for the largest possible delta file,
+	 * so that the mapping never moves when the file grows. */
+	overlay = mmap(NULL, data_off + (size_t)nr_block * BLOCK_SIZE,
+			PROT_READ | PROT_WRITE, MAP_SHARED, overlay_fd, 0);
+	Assert(overlay != MAP_FAILED, "Can not map '%s'", overlay_file);
+
+	hdr = (void *)overlay;
+	map = (void *)(overlay + sizeof(overlay_header));
+
+	if(is_new) {
+		memcpy(hdr->magic, OVERLAY_MAGIC, sizeof(hdr->magic));
+		hdr->block_size = BLOCK_SIZE;
+		hdr->nr_block = nr_block;
+		hdr->nr_alloc = 0;
+		hdr->base_size = disk_size;
+	}
+	else {
+		Assert(memcmp(hdr->magic, OVERLAY_MAGIC, sizeof(hdr->magic)) == 0,
+				"'%s' is not a disk overlay", overlay_file);
+		Assert(hdr->block_size == BLOCK_SIZE && hdr->base_size == disk_size,
+				"'%s' does not match the base image", overlay_file);
+	}
+}
+
+void init_disk(const char *image) {
+	image_file = image;
+
+	/* The base image is never written when an overlay is used. */
+	int fd = open(image, (overlay_file ? O_RDONLY : O_RDWR));
+	Assert(fd >= 0, "Can not open '%s'", image);
+
+	struct stat st;
+	int ret = fstat(fd, &st);
+	assert(ret == 0);
+	disk_size = st.st_size;
+
+	base = mmap(NULL, disk_size, (overlay_file ? PROT_READ : PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+	Assert(base != MAP_FAILED, "Can not map '%s'", image);
+	close(fd);
+
+	if(overlay_file) {
+		init_overlay();
+		if(overlay_commit) {
+			atexit(disk_commit_at_exit);
+		}
+	}
+}
@@ -2,6 +2,10 @@
 #include "memory/memory.h"
 #include "device/port-io.h"
 #include "device/i8259.h"
+#include "device/disk.h"
+#include "monitor/monitor.h"
+
+#include <pthread.h>
 
 #define IDE_CTRL_PORT 0x3F6
 #define IDE_PORT 0x1F0
@@ -9,114 +13,301 @@
 
 #define IDE_IRQ 14
 
+/* status register */
+#define IDE_STATUS_DRQ  0x08
+#define IDE_STATUS_DRDY 0x40
+#define IDE_STATUS_BSY  0x80
+
+/* commands */
+#define IDE_CMD_READ          0x20
+#define IDE_CMD_WRITE         0x30
+#define IDE_CMD_READ_MULTIPLE 0xc4
+#define IDE_CMD_WRITE_MULTIPLE 0xc5
+#define IDE_CMD_READ_DMA      0xc8
+#define IDE_CMD_WRITE_DMA     0xca
+
+/* bus master registers */
+#define BMR_CMD_START   0x1
+#define BMR_CMD_READ    0x8		/* from the view of memory: disk -> memory */
+#define BMR_STATUS_ACTIVE 0x1
+#define BMR_STATUS_INTR 0x4
+
+#define PRD_EOT 0x80000000
+
 static uint8_t *ide_port_base;
 static uint8_t *bmr_base;	/* bus master registers */
 
 static uint32_t sector, disk_idx;
-static uint32_t byte_cnt;
+static uint32_t byte_cnt, nr_byte;
 static bool ide_write;
-static FILE *disk_fp;
+
+static void ide_prepare_transfer() {
+	sector = (ide_port_base[6] & 0x1f) << 24 | ide_port_base[5] << 16
+		| ide_port_base[4] << 8 | ide_port_base[3];
+	disk_idx = sector << 9;
+
+	/* a sector count of 0 means 256 sectors */
+	uint32_t nr_sector = (ide_port_base[2] == 0 ? 256 : ide_port_base[2]);
+	nr_byte = nr_sector << 9;
+	byte_cnt = 0;
+}
+
+static void ide_finish_transfer(size_t len) {
+	disk_idx += len;
+	byte_cnt += len;
+	if(byte_cnt == nr_byte) {
+		/* finish */
+		ide_port_base[7] = IDE_STATUS_DRDY;
+	}
+}
 
 void ide_io_handler(ioaddr_t addr, size_t len, bool is_write) {
-	assert(byte_cnt <= 512);
-	int ret;
+	assert(byte_cnt <= nr_byte);
 	if(is_write) {
-		if(addr - IDE_PORT == 0 && len == 4) {
-			/* write 4 bytes data to disk */
-			assert(ide_write);
-			ret = fwrite(ide_port_base, 4, 1, disk_fp);
-			assert(ret == 1);
-
-			byte_cnt += 4;
-			if(byte_cnt == 512) {
-				/* finish */
-				ide_port_base[7] = 0x40;
-			}
+		if(addr - IDE_PORT == 0 && (len == 2 || len == 4)) {
+			/* write data to disk */
+			assert(ide_write && byte_cnt < nr_byte);
+			disk_write(ide_port_base, disk_idx, len);
+			ide_finish_transfer(len);
 		}
 		else if(addr - IDE_PORT == 7) {
-			if(ide_port_base[7] == 0x20 || ide_port_base[7] == 0x30) {
-				/* command: read/write */
-				sector = (ide_port_base[6] & 0x1f) << 24 | ide_port_base[5] << 16
-					| ide_port_base[4] << 8 | ide_port_base[3];
-				disk_idx = sector << 9;
-				fseek(disk_fp, disk_idx, SEEK_SET);
-
-				byte_cnt = 0;
-
-				if(ide_port_base[7] == 0x20) {
+			switch(ide_port_base[7]) {
+				case IDE_CMD_READ:
+				case IDE_CMD_READ_MULTIPLE:
 					/* command: read from disk */
+					ide_prepare_transfer();
 					ide_write = false;
-					ide_port_base[7] = 0x40;
+					ide_port_base[7] = IDE_STATUS_DRDY | IDE_STATUS_DRQ;
 					i8259_raise_intr(IDE_IRQ);
-				}
-				else {
+					break;
+
+				case IDE_CMD_WRITE:
+				case IDE_CMD_WRITE_MULTIPLE:
 					/* command: write to disk */
+					ide_prepare_transfer();
 					ide_write = true;
-				}
-			}
-			else if (ide_port_base[7] == 0xc8) {
-				/* command: DMA read */
+					ide_port_base[7] = IDE_STATUS_DRDY | IDE_STATUS_DRQ;
+					break;
 
-				/* Nothing to do here. The actual read operation is
-				 * issued by write commands to the bus master register. */
-			}
-			else {
-				/* not implemented command */
-				assert(0);
+				case IDE_CMD_READ_DMA:
+				case IDE_CMD_WRITE_DMA:
+					/* Nothing to do here. The actual read/write operation is
+					 * issued by write commands to the bus master register. */
+					ide_prepare_transfer();
+					ide_port_base[7] = IDE_STATUS_DRDY;
+					break;
+
+				default:
+					/* not implemented command */
+					panic("IDE command 0x%x is not implemented", ide_port_base[7]);
 			}
 		}
 	}
 	else {
-		if(addr - IDE_PORT == 0 && len == 4) {
-			/* read 4 bytes data from disk */
-			assert(!ide_write);
-			ret = fread(ide_port_base, 4, 1, disk_fp);
-			assert(ret == 1 || feof(disk_fp));
-
-			byte_cnt += 4;
-			if(byte_cnt == 512) {
-				/* finish */
-				ide_port_base[7] = 0x40;
-			}
+		if(addr - IDE_PORT == 0 && (len == 2 || len == 4)) {
+			/* read data from disk */
+			assert(!ide_write && byte_cnt < nr_byte);
+			disk_read(ide_port_base, disk_idx, len);
+			ide_finish_transfer(len);
 		}
 	}
 }
 
-void bmr_io_handler(ioaddr_t addr, size_t len, bool is_write) {
-	int ret;
+/* rep ins/outs on the data port: copy the rest of the current transfer
+ * between the disk and the guest buffer in one shot.
+ */
+size_t ide_string_handler(ioaddr_t addr, size_t len, void *buf, size_t count, bool is_write) {
+	if(addr != IDE_PORT || (len != 2 && len != 4) || ide_write != is_write) {
+		return 0;
+	}
+
+	size_t n = (nr_byte - byte_cnt) / len;
+	if(n > count) { n = count; }
 	if(is_write) {
-		if(addr - BMR_PORT == 0) {
-			if(bmr_base[0] & 0x1) {
-				/* DMA start command */
-				if(bmr_base[0] & 0x8) {
-					/* DMA read */
+		disk_write(buf, disk_idx, n * len);
+	}
+	else {
+		disk_read(buf, disk_idx, n * len);
+	}
+	ide_finish_transfer(n * len);
+	return n;
+}
 
-					/* the address of Physical Region Descriptor Table */
-					hwaddr_t prdt_addr = *(uint32_t *)(bmr_base + 4);
+/* DMA requests are served by an I/O thread, so that the guest keeps
+ * executing while the host is copying data. The completion interrupt is
+ * raised when both the I/O thread has finished the copying and the modeled
+ * latency (counted in guest instructions) has elapsed.
+ *
+ * The I/O thread never touches guest memory, which the CPU keeps using
+ * through the row buffers of DRAM. It only moves data between the disk and
+ * a bounce buffer, which the CPU thread fills at submission (for writes to
+ * the disk) or copies into guest memory at completion (for reads).
+ */
+#define DMA_LATENCY_BASE 20000
+#define DMA_LATENCY_PER_SECTOR 2000
 
-					hwaddr_t addr = hwaddr_read(prdt_addr, 4);
-					uint32_t hi_entry = hwaddr_read(prdt_addr + 4, 4);
-					uint16_t byte_cnt = hi_entry & 0xffff;
+#define NR_PRD 64
 
-					sector = (ide_port_base[6] & 0x1f) << 24 | ide_port_base[5] << 16
-						| ide_port_base[4] << 8 | ide_port_base[3];
-					disk_idx = sector << 9;
-					fseek(disk_fp, disk_idx, SEEK_SET);
+static struct {
+	bool busy;			/* a request is in flight */
+	bool submitted;		/* handed to the I/O thread, protected by `lock' */
+	bool done;			/* finished by the I/O thread, protected by `lock' */
+	bool to_memory;
+	uint32_t disk_idx;
+	uint32_t len;		/* the bytes in the bounce buffer */
+	int nr_prd;
+	struct {
+		hwaddr_t addr;
+		uint32_t len;
+	} prd[NR_PRD];
+	uint64_t deadline;
+} dma;
 
-					ret = fread((void *)hwa_to_va(addr), byte_cnt, 1, disk_fp);
-					assert(ret == 1 || feof(disk_fp));
+/* a command transfers at most 256 sectors */
+static uint8_t bounce[256 * 512];
 
-					/* We only implement PRDT of single entry. */
-					assert(hi_entry & 0x80000000);
+static pthread_t io_thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 
-					/* finish */
-					ide_port_base[7] = 0x40;
-					i8259_raise_intr(IDE_IRQ);
-				}
-				else {
-					/* DMA write is not implemented */
-					assert(0);
-				}
+static void* io_thread_main(void *arg) {
+	pthread_mutex_lock(&lock);
+	while(1) {
+		while(!dma.submitted) {
+			pthread_cond_wait(&cond, &lock);
+		}
+
+		if(dma.to_memory) {
+			disk_read(bounce, dma.disk_idx, dma.len);
+		}
+		else {
+			disk_write(bounce, dma.disk_idx, dma.len);
+		}
+
+		dma.submitted = false;
+		dma.done = true;
+		pthread_cond_broadcast(&cond);
+	}
+	return NULL;
+}
+
+/* Walk through the Physical Region Descriptor Table and hand the
+ * request to the I/O thread.
+ */
+static void dma_submit(bool to_memory) {
+	assert(!dma.busy);
+
+	/* the address of Physical Region Descriptor Table */
+	hwaddr_t prdt_addr = *(uint32_t *)(bmr_base + 4);
+	uint32_t hi_entry;
+
+	dma.nr_prd = 0;
+	do {
+		assert(dma.nr_prd < NR_PRD);
+		hwaddr_t addr = hwaddr_read(prdt_addr, 4);
+		hi_entry = hwaddr_read(prdt_addr + 4, 4);
+		prdt_addr += 8;
+
+		/* a byte count of 0 means 64KB */
+		uint32_t len = hi_entry & 0xffff;
+		if(len == 0) { len = 0x10000; }
+		if(len > nr_byte - byte_cnt) { len = nr_byte - byte_cnt; }
+
+		Assert(addr + len <= HW_MEM_SIZE, "DMA to physical address 0x%08x is out of bound", addr);
+		dma.prd[dma.nr_prd].addr = addr;
+		dma.prd[dma.nr_prd].len = len;
+		dma.nr_prd ++;
+
+		byte_cnt += len;
+	} while(!(hi_entry & PRD_EOT) && byte_cnt < nr_byte);
+
+	/* gather the data to write into the bounce buffer */
+	int i;
+	uint32_t len = 0;
+	for(i = 0; i < dma.nr_prd; i ++) {
+		assert(len + dma.prd[i].len <= sizeof(bounce));
+		if(!to_memory) {
+			memcpy(bounce + len, hwa_to_va(dma.prd[i].addr), dma.prd[i].len);
+		}
+		len += dma.prd[i].len;
+	}
+
+	dma.busy = true;
+	dma.to_memory = to_memory;
+	dma.disk_idx = disk_idx;
+	dma.len = len;
+	dma.deadline = instr_count + DMA_LATENCY_BASE + DMA_LATENCY_PER_SECTOR * (byte_cnt >> 9);
+	disk_idx += byte_cnt;
+
+	ide_port_base[7] = IDE_STATUS_BSY | IDE_STATUS_DRDY;
+	bmr_base[2] |= BMR_STATUS_ACTIVE;
+
+	pthread_mutex_lock(&lock);
+	dma.done = false;
+	dma.submitted = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void dma_complete() {
+	int i;
+	if(dma.to_memory) {
+		/* scatter the data read into guest memory */
+		uint32_t len = 0;
+		for(i = 0; i < dma.nr_prd; i ++) {
+			memcpy(hwa_to_va(dma.prd[i].addr), bounce + len, dma.prd[i].len);
+			dram_invalidate(dma.prd[i].addr, dma.prd[i].len);
+			len += dma.prd[i].len;
+		}
+	}
+
+	dma.busy = false;
+	bmr_base[0] &= ~BMR_CMD_START;
+	bmr_base[2] = (bmr_base[2] & ~BMR_STATUS_ACTIVE) | BMR_STATUS_INTR;
+	ide_port_base[7] = IDE_STATUS_DRDY;
+	i8259_raise_intr(IDE_IRQ);
+}
+
+/* Called by the device layer after every instruction. */
+void ide_update() {
+	if(!dma.busy || instr_count < dma.deadline) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	bool done = dma.done;
+	pthread_mutex_unlock(&lock);
+
+	if(done) {
+		dma_complete();
+	}
+}
+
+/* Called by the device layer when the CPU is idle. The pending DMA request
+ * is the next device event, so skip the rest of its latency and wait for
+ * the I/O thread directly. Return whether a completion is delivered.
+ */
+bool ide_idle() {
+	if(!dma.busy) {
+		return false;
+	}
+
+	pthread_mutex_lock(&lock);
+	while(!dma.done) {
+		pthread_cond_wait(&cond, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+
+	dma_complete();
+	return true;
+}
+
+void bmr_io_handler(ioaddr_t addr, size_t len, bool is_write) {
+	if(is_write) {
+		if(addr - BMR_PORT == 0) {
+			if((bmr_base[0] & BMR_CMD_START) && !dma.busy) {
+				/* DMA start command */
+				dma_submit(bmr_base[0] & BMR_CMD_READ);
 			}
 		}
 	}
@@ -124,12 +315,17 @@ void bmr_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 
 void init_ide() {
 	ide_port_base = add_pio_map(IDE_PORT, 8, ide_io_handler);
-	ide_port_base[7] = 0x40;
+	ide_port_base[7] = IDE_STATUS_DRDY;
+	add_pio_string_handler(IDE_PORT, ide_string_handler);
+	add_pio_poll_port(IDE_PORT + 7);
 
 	bmr_base = add_pio_map(BMR_PORT, 8, bmr_io_handler);
 	bmr_base[0] = 0;
+	add_pio_poll_port(BMR_PORT + 2);
 
 	extern char *exec_file;
-	disk_fp = fopen(exec_file, "r+");
-	Assert(disk_fp, "Can not open '%s'", exec_file);
+	init_disk(exec_file);
+
+	int ret = pthread_create(&io_thread, NULL, io_thread_main, NULL);
+	Assert(ret == 0, "Can not create the IDE I/O thread");
 }
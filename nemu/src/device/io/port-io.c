@@ -1,5 +1,6 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "cpu/reg.h"
 
 #define PORT_IO_SPACE_MAX 65536
 #define NR_MAP 8
@@ -11,19 +12,64 @@ typedef struct {
 	ioaddr_t low;
 	ioaddr_t high;
 	pio_callback_t callback;
+	pio_string_callback_t string_callback;
 } PIO_t;
 
 static PIO_t maps[NR_MAP];
 static int nr_map = 0;
 
-static void pio_callback(ioaddr_t addr, size_t len, bool is_write) {
+/* A guest spinning on a device status port can not make progress until
+ * some device event changes the value it reads. After the same instruction
+ * reads the same value from the same status port POLL_THRESHOLD times in a
+ * row, let the devices fast-forward to their next event instead. Devices
+ * mark their status ports by add_pio_poll_port(), so that reading the same
+ * data again and again from a data port is not taken as idle.
+ */
+#define POLL_THRESHOLD 64
+
+static uint8_t pollable[PORT_IO_SPACE_MAX / 8];
+
+static struct {
+	swaddr_t eip;
+	ioaddr_t addr;
+	uint32_t data;
+	int count;
+} poll;
+
+static void detect_polling(ioaddr_t addr, uint32_t data) {
+	if(cpu.eip == poll.eip && addr == poll.addr && data == poll.data) {
+		poll.count ++;
+		if(poll.count >= POLL_THRESHOLD) {
+#ifdef HAS_DEVICE
+			void device_idle();
+			device_idle();
+#endif
+			poll.count = 0;
+		}
+	}
+	else {
+		poll.eip = cpu.eip;
+		poll.addr = addr;
+		poll.data = data;
+		poll.count = 0;
+	}
+}
+
+static PIO_t* find_map(ioaddr_t addr, size_t len) {
 	int i;
 	for(i = 0; i < nr_map; i ++) {
 		if(addr >= maps[i].low && addr + len - 1 <= maps[i].high) {
-			maps[i].callback(addr, len, is_write);
-			return;
+			return &maps[i];
 		}
 	}
+	return NULL;
+}
+
+static void pio_callback(ioaddr_t addr, size_t len, bool is_write) {
+	PIO_t *map = find_map(addr, len);
+	if(map != NULL) {
+		map->callback(addr, len, is_write);
+	}
 }
 
 /* device interface */
@@ -33,10 +79,23 @@ void* add_pio_map(ioaddr_t addr, size_t len, pio_callback_t callback) {
 	maps[nr_map].low = addr;
 	maps[nr_map].high = addr + len - 1;
 	maps[nr_map].callback = callback;
+	maps[nr_map].string_callback = NULL;
 	nr_map ++;
 	return pio_space + addr;
 }
 
+/* Let the device mapped at `addr' serve string I/O (rep ins/outs) in bulk. */
+void add_pio_string_handler(ioaddr_t addr, pio_string_callback_t callback) {
+	PIO_t *map = find_map(addr, 1);
+	assert(map != NULL);
+	map->string_callback = callback;
+}
+
+/* Let the reads of the status port `addr' be checked for polling loops. */
+void add_pio_poll_port(ioaddr_t addr) {
+	assert(addr < PORT_IO_SPACE_MAX);
+	pollable[addr >> 3] |= 1 << (addr & 7);
+}
 
 /* CPU interface */
 uint32_t pio_read(ioaddr_t addr, size_t len) {
@@ -44,6 +103,9 @@ uint32_t pio_read(ioaddr_t addr, size_t len) {
 	assert(addr + len - 1 < PORT_IO_SPACE_MAX);
 	pio_callback(addr, len, false);		// prepare data to read
 	uint32_t data = *(uint32_t *)(pio_space + addr) & (~0u >> ((4 - len) << 3));
+	if(pollable[addr >> 3] & (1 << (addr & 7))) {
+		detect_polling(addr, data);
+	}
 	return data;
 }
 
@@ -52,5 +114,42 @@ void pio_write(ioaddr_t addr, size_t len, uint32_t data) {
 	assert(addr + len - 1 < PORT_IO_SPACE_MAX);
 	memcpy(pio_space + addr, &data, len);
 	pio_callback(addr, len, true);
+	poll.count = 0;
 }
 
+
+/* Transfer `count' data of `len' bytes between the port `addr' and the
+ * buffer `buf' in NEMU. The device moves as many data as it can in one
+ * shot, and the rest is transferred one by one.
+ */
+static void pio_string(ioaddr_t addr, size_t len, void *buf, size_t count, bool is_write) {
+	assert(len == 1 || len == 2 || len == 4);
+	assert(addr + len - 1 < PORT_IO_SPACE_MAX);
+	PIO_t *map = find_map(addr, len);
+	size_t done = 0;
+	if(map != NULL && map->string_callback != NULL) {
+		done = map->string_callback(addr, len, buf, count, is_write);
+		assert(done <= count);
+	}
+
+	uint8_t *p = (uint8_t *)buf + done * len;
+	for(; done < count; done ++, p += len) {
+		if(is_write) {
+			memcpy(pio_space + addr, p, len);
+			pio_callback(addr, len, true);
+		}
+		else {
+			pio_callback(addr, len, false);
+			memcpy(p, pio_space + addr, len);
+		}
+	}
+	poll.count = 0;
+}
+
+void pio_read_string(ioaddr_t addr, size_t len, void *buf, size_t count) {
+	pio_string(addr, len, buf, count, false);
+}
+
+void pio_write_string(ioaddr_t addr, size_t len, const void *buf, size_t count) {
+	pio_string(addr, len, (void *)buf, count, true);
+}
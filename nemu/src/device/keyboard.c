@@ -1,16 +1,40 @@
 #include "device/port-io.h"
 #include "device/i8259.h"
 #include "monitor/monitor.h"
+#include "sdl.h"
+
+#include <stdlib.h>
+#include <ctype.h>
 
 #define I8042_DATA_PORT 0x60
 #define KEYBOARD_IRQ 1
 
+/* Scancodes wait in this FIFO until the guest has read the previous one,
+ * so no key is lost when the guest is slow to service the interrupt.
+ */
+#define KBD_FIFO_SIZE 256
+
 static uint8_t *i8042_data_port_base;
 static bool newkey;
 
+static uint8_t fifo[KBD_FIFO_SIZE];
+static int fifo_head, fifo_tail;
+
 void keyboard_intr(uint8_t scancode) {
-	if(nemu_state == RUNNING && newkey == false) {
-		i8042_data_port_base[0] = scancode;
+	if(nemu_state == RUNNING) {
+		int next = (fifo_tail + 1) % KBD_FIFO_SIZE;
+		if(next != fifo_head) {
+			fifo[fifo_tail] = scancode;
+			fifo_tail = next;
+		}
+	}
+}
+
+/* Called by the device layer after every instruction. */
+void i8042_update() {
+	if(newkey == false && fifo_head != fifo_tail) {
+		i8042_data_port_base[0] = fifo[fifo_head];
+		fifo_head = (fifo_head + 1) % KBD_FIFO_SIZE;
 		i8259_raise_intr(KEYBOARD_IRQ);
 		newkey = true;
 	}
@@ -22,8 +46,139 @@ void i8042_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 	}
 }
 
+/* Keyboard input script, given by the `-k' option.
+ * Each line is an event of the form
+ *
+ *     <time> <down|up|press> <key>
+ *
+ * where <time> is the virtual time in milliseconds since the system
+ * started, and <key> is a scancode (e.g. 0x1c), a character (e.g. a),
+ * or one of the names in key_names[] below. `press' is a shorthand for
+ * a `down' followed by an `up'. Lines starting with `#' are comments.
+ * Events must be sorted by time.
+ *
+ * The virtual time is counted in executed instructions, at
+ * INSTR_PER_MS instructions per millisecond, so the same script
+ * delivers every key at the same instruction in every run.
+ */
+char *kbd_script_file = NULL;
+
+#define INSTR_PER_MS 10000
+
+typedef struct {
+	uint32_t time;
+	uint8_t scancode;
+} kbd_event;
+
+static kbd_event *events;
+static int nr_event, event_idx;
+
+static const struct {
+	const char *name;
+	uint8_t scancode;
+} key_names[] = {
+	{ "esc", K_ESC }, { "enter", K_ENTER }, { "space", K_SPACE },
+	{ "tab", K_TAB }, { "backspace", K_BACK }, { "lshift", K_LSHIFT },
+	{ "rshift", K_RSHIFT }, { "lctrl", K_LCTRL }, { "lalt", K_LALT },
+	{ "up", K_UP }, { "down", K_DOWN }, { "left", K_LEFT }, { "right", K_RIGHT },
+	{ "pageup", K_PAGEUP }, { "pagedown", K_PAGEDOWN },
+	{ "home", K_HOME }, { "end", K_END }, { "insert", K_INSERT }, { "delete", K_DELETE },
+	{ "f1", K_F1 }, { "f2", K_F2 }, { "f3", K_F3 }, { "f4", K_F4 },
+	{ "f5", K_F5 }, { "f6", K_F6 }, { "f7", K_F7 }, { "f8", K_F8 },
+	{ "f9", K_F9 }, { "f10", K_F10 }, { "f11", K_F11 }, { "f12", K_F12 },
+};
+
+#define NR_KEY_NAME (sizeof(key_names) / sizeof(key_names[0]))
+
+static int parse_key(const char *key) {
+	int i;
+	if(key[0] != '\0' && key[1] == '\0' && (unsigned char)key[0] < 128) {
+		/* a single character, whose SDL key symbol is itself */
+		return sym2scancode[0][tolower(key[0])];
+	}
+
+	for(i = 0; i < NR_KEY_NAME; i ++) {
+		if(strcmp(key, key_names[i].name) == 0) {
+			return key_names[i].scancode;
+		}
+	}
+
+	char *end;
+	long scancode = strtol(key, &end, 0);
+	if(*end == '\0' && scancode > 0 && scancode < 0x80) {
+		return scancode;
+	}
+	return UNDEF;
+}
+
+static void add_event(uint32_t time, uint8_t scancode) {
+	static int capacity = 0;
+	if(nr_event == capacity) {
+		capacity = (capacity == 0 ? 64 : capacity * 2);
+		events = realloc(events, capacity * sizeof(kbd_event));
+		assert(events);
+	}
+	events[nr_event].time = time;
+	events[nr_event].scancode = scancode;
+	nr_event ++;
+}
+
+static void load_kbd_script() {
+	FILE *fp = fopen(kbd_script_file, "r");
+	Assert(fp, "Can not open '%s'", kbd_script_file);
+
+	char line[128], action[16], key[32];
+	uint32_t time, last_time = 0;
+	int lineno = 0;
+	while(fgets(line, sizeof(line), fp)) {
+		lineno ++;
+		if(line[0] == '#' || sscanf(line, "%u %15s %31s", &time, action, key) != 3) {
+			continue;
+		}
+
+		int scancode = parse_key(key);
+		Assert(scancode != UNDEF, "%s:%d: unknown key '%s'", kbd_script_file, lineno, key);
+		Assert(time >= last_time, "%s:%d: events are not sorted by time", kbd_script_file, lineno);
+		last_time = time;
+
+		if(strcmp(action, "down") == 0) {
+			add_event(time, scancode);
+		}
+		else if(strcmp(action, "up") == 0) {
+			add_event(time, scancode | 0x80);
+		}
+		else if(strcmp(action, "press") == 0) {
+			add_event(time, scancode);
+			add_event(time, scancode | 0x80);
+		}
+		else {
+			panic("%s:%d: unknown action '%s'", kbd_script_file, lineno, action);
+		}
+	}
+	fclose(fp);
+
+	Log("%d keyboard events loaded from '%s'", nr_event, kbd_script_file);
+}
+
+/* Feed the events in the script which are due now. */
+void kbd_script_update() {
+	if(event_idx == nr_event) {
+		return;
+	}
+
+	uint64_t now = instr_count / INSTR_PER_MS;
+	while(event_idx < nr_event && events[event_idx].time <= now) {
+		keyboard_intr(events[event_idx].scancode);
+		event_idx ++;
+	}
+}
+
 void init_i8042() {
 	i8042_data_port_base = add_pio_map(I8042_DATA_PORT, 1, i8042_io_handler);
 	newkey = false;
-}
+	fifo_head = fifo_tail = 0;
 
+	if(kbd_script_file) {
+		load_kbd_script();
+	}
+}
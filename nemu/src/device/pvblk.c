@@ -0,0 +1,164 @@
+#include "common.h"
+#include "memory/memory.h"
+#include "device/port-io.h"
+#include "device/i8259.h"
+#include "device/disk.h"
+
+/* A paravirtual block device in the style of virtio-blk. Instead of
+ * emulating the register interface of a real disk controller, requests are
+ * placed in a queue in guest physical memory, and the driver notifies the
+ * device with a single write to the doorbell register per batch of requests.
+ * It is backed by the same disk image as the IDE disk.
+ *
+ * Registers (4 bytes each):
+ *   0: physical address of the queue, writing to it resets the queue
+ *   4: doorbell, writing any value makes the device serve all available requests
+ *   8: capacity of the disk in sectors (read only)
+ *
+ * A request is a chain of descriptors: a header (pvblk_req_hdr) which is
+ * read by the device, one or more data buffers, and a one-byte status which
+ * is written by the device.
+ */
+
+#define PVBLK_PORT 0xc080
+#define PVBLK_IRQ 15
+
+#define PVBLK_QUEUE_SIZE 64
+
+#define PVBLK_DESC_NEXT  0x1
+#define PVBLK_DESC_WRITE 0x2	/* the buffer is written by the device */
+
+#define PVBLK_AVAIL_NO_INTR 0x1
+
+#define PVBLK_T_IN  0
+#define PVBLK_T_OUT 1
+
+#define PVBLK_S_OK     0
+#define PVBLK_S_IOERR  1
+#define PVBLK_S_UNSUPP 2
+
+typedef struct {
+	uint32_t addr;
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+} pvblk_desc;
+
+typedef struct {
+	uint32_t type;
+	uint32_t sector;
+} pvblk_req_hdr;
+
+typedef struct {
+	pvblk_desc desc[PVBLK_QUEUE_SIZE];
+	struct {
+		uint16_t flags;
+		uint16_t idx;
+		uint16_t ring[PVBLK_QUEUE_SIZE];
+	} avail;
+	struct {
+		uint16_t flags;
+		uint16_t idx;
+		struct {
+			uint32_t id;
+			uint32_t len;
+		} ring[PVBLK_QUEUE_SIZE];
+	} used;
+} pvblk_queue;
+
+static uint32_t *pvblk_base;
+static pvblk_queue *queue;
+static uint16_t last_avail_idx;
+
+static inline void* guest_buf(uint32_t addr, uint32_t len) {
+	Assert(addr < HW_MEM_SIZE && len <= HW_MEM_SIZE - addr,
+			"pvblk buffer at physical address 0x%08x is out of bound", addr);
+	return hwa_to_va(addr);
+}
+
+static inline pvblk_desc* get_desc(uint16_t idx) {
+	Assert(idx < PVBLK_QUEUE_SIZE, "pvblk descriptor index %d is out of bound", idx);
+	return &queue->desc[idx];
+}
+
+/* Serve the request whose descriptor chain starts at `head'.
+ * Return the number of bytes written into guest memory.
+ */
+static uint32_t serve_request(uint16_t head) {
+	pvblk_desc *d = get_desc(head);
+	Assert(d->len >= sizeof(pvblk_req_hdr) && (d->flags & PVBLK_DESC_NEXT), "bad pvblk request header");
+	pvblk_req_hdr *hdr = guest_buf(d->addr, sizeof(pvblk_req_hdr));
+	uint32_t type = hdr->type;
+	uint32_t offset = hdr->sector << 9;
+
+	uint8_t status = PVBLK_S_OK;
+	uint32_t written = 0;
+	int nr_desc = 1;
+
+	d = get_desc(d->next);
+	while(d->flags & PVBLK_DESC_NEXT) {
+		Assert(++ nr_desc < PVBLK_QUEUE_SIZE, "pvblk descriptor chain is too long");
+		void *buf = guest_buf(d->addr, d->len);
+		if(type == PVBLK_T_IN && (d->flags & PVBLK_DESC_WRITE)) {
+			disk_read(buf, offset, d->len);
+			dram_invalidate(d->addr, d->len);
+			written += d->len;
+		}
+		else if(type == PVBLK_T_OUT && !(d->flags & PVBLK_DESC_WRITE)) {
+			disk_write(buf, offset, d->len);
+		}
+		else {
+			status = PVBLK_S_UNSUPP;
+		}
+		offset += d->len;
+		d = get_desc(d->next);
+	}
+
+	/* the last descriptor is the status byte */
+	Assert(d->len >= 1 && (d->flags & PVBLK_DESC_WRITE), "bad pvblk request status");
+	*(uint8_t *)guest_buf(d->addr, 1) = status;
+	dram_invalidate(d->addr, 1);
+	return written + 1;
+}
+
+static void pvblk_kick() {
+	Assert(queue != NULL, "pvblk queue is not set up");
+
+	bool served = false;
+	while(last_avail_idx != queue->avail.idx) {
+		uint16_t head = queue->avail.ring[last_avail_idx % PVBLK_QUEUE_SIZE];
+		uint32_t len = serve_request(head);
+
+		uint16_t used_idx = queue->used.idx;
+		queue->used.ring[used_idx % PVBLK_QUEUE_SIZE].id = head;
+		queue->used.ring[used_idx % PVBLK_QUEUE_SIZE].len = len;
+		queue->used.idx = used_idx + 1;
+
+		last_avail_idx ++;
+		served = true;
+	}
+	dram_invalidate(va_to_hwa(&queue->used), sizeof(queue->used));
+
+	/* one interrupt for the whole batch */
+	if(served && !(queue->avail.flags & PVBLK_AVAIL_NO_INTR)) {
+		i8259_raise_intr(PVBLK_IRQ);
+	}
+}
+
+void pvblk_io_handler(ioaddr_t addr, size_t len, bool is_write) {
+	if(is_write) {
+		switch(addr - PVBLK_PORT) {
+			case 0:
+				queue = guest_buf(pvblk_base[0], sizeof(pvblk_queue));
+				last_avail_idx = queue->avail.idx;
+				break;
+			case 4: pvblk_kick(); break;
+		}
+	}
+}
+
+void init_pvblk() {
+	pvblk_base = add_pio_map(PVBLK_PORT, 12, pvblk_io_handler);
+	pvblk_base[2] = disk_capacity() >> 9;
+	queue = NULL;
+}
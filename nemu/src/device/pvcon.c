@@ -0,0 +1,121 @@
+#include "common.h"
+#include "memory/memory.h"
+#include "device/port-io.h"
+#include "device/i8259.h"
+
+/* A paravirtual console. Unlike the serial port, which costs one port
+ * write per character, the guest puts whole buffers into the output ring
+ * in its memory and notifies the device with a single doorbell write.
+ * Data for the guest, read from the file given by the `-i' option, is put
+ * into the input ring, and an interrupt is raised when new data arrives.
+ *
+ * Registers (4 bytes each):
+ *   0: physical address of the output ring
+ *   4: physical address of the input ring
+ *   8: doorbell, writing any value flushes the output ring
+ *
+ * Each ring is a single-producer, single-consumer byte queue. `head' is
+ * only advanced by the producer and `tail' only by the consumer, both are
+ * free-running and taken modulo PVCON_RING_SIZE.
+ */
+
+#define PVCON_PORT 0xc0a0
+#define PVCON_IRQ 3
+
+#define PVCON_RING_SIZE 4096
+
+typedef struct {
+	uint32_t head;
+	uint32_t tail;
+	uint8_t buf[PVCON_RING_SIZE];
+} pvcon_ring;
+
+/* the input of the console, set by the `-i' option */
+char *console_input_file = NULL;
+
+static uint32_t *pvcon_base;
+static pvcon_ring *out_ring, *in_ring;
+static FILE *input_fp;
+
+static pvcon_ring* get_ring(hwaddr_t addr) {
+	Assert(addr < HW_MEM_SIZE && sizeof(pvcon_ring) <= HW_MEM_SIZE - addr,
+			"pvcon ring at physical address 0x%08x is out of bound", addr);
+	return hwa_to_va(addr);
+}
+
+static void pvcon_flush() {
+	if(out_ring == NULL) {
+		return;
+	}
+
+	uint32_t tail = out_ring->tail, head = out_ring->head;
+	Assert(head - tail <= PVCON_RING_SIZE, "pvcon output ring is corrupted");
+	while(tail != head) {
+		/* write the contiguous part in one shot */
+		uint32_t off = tail % PVCON_RING_SIZE;
+		uint32_t n = PVCON_RING_SIZE - off;
+		if(n > head - tail) { n = head - tail; }
+		fwrite(out_ring->buf + off, 1, n, stdout);
+		tail += n;
+	}
+	fflush(stdout);
+
+	out_ring->tail = tail;
+	dram_invalidate(va_to_hwa(&out_ring->tail), 4);
+}
+
+/* Move as much input as the input ring can hold into it. */
+static void pvcon_feed() {
+	if(in_ring == NULL || input_fp == NULL) {
+		return;
+	}
+
+	uint32_t head = in_ring->head, tail = in_ring->tail;
+	bool fed = false;
+	while(head - tail < PVCON_RING_SIZE) {
+		uint32_t off = head % PVCON_RING_SIZE;
+		uint32_t n = PVCON_RING_SIZE - off;
+		if(n > PVCON_RING_SIZE - (head - tail)) { n = PVCON_RING_SIZE - (head - tail); }
+		size_t nread = fread(in_ring->buf + off, 1, n, input_fp);
+		if(nread == 0) {
+			/* end of input */
+			fclose(input_fp);
+			input_fp = NULL;
+			break;
+		}
+		dram_invalidate(va_to_hwa(in_ring->buf + off), nread);
+		head += nread;
+		fed = true;
+	}
+
+	if(fed) {
+		in_ring->head = head;
+		dram_invalidate(va_to_hwa(&in_ring->head), 4);
+		i8259_raise_intr(PVCON_IRQ);
+	}
+}
+
+/* Called by the device layer at every timer tick. */
+void pvcon_update() {
+	pvcon_feed();
+}
+
+void pvcon_io_handler(ioaddr_t addr, size_t len, bool is_write) {
+	if(is_write) {
+		switch(addr - PVCON_PORT) {
+			case 0: out_ring = get_ring(pvcon_base[0]); break;
+			case 4: in_ring = get_ring(pvcon_base[1]); pvcon_feed(); break;
+			case 8: pvcon_flush(); pvcon_feed(); break;
+		}
+	}
+}
+
+void init_pvcon() {
+	pvcon_base = add_pio_map(PVCON_PORT, 12, pvcon_io_handler);
+	out_ring = in_ring = NULL;
+
+	if(console_input_file) {
+		input_fp = fopen(console_input_file, "r");
+		Assert(input_fp, "Can not open '%s'", console_input_file);
+	}
+}
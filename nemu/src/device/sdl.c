@@ -1,5 +1,9 @@
 #include "common.h"
 
+/* sleep the host until the next timer tick when the guest is idle,
+ * set by the `-r' option */
+bool idle_real_time = false;
+
 #ifdef HAS_DEVICE
 
 #include "sdl.h"
@@ -7,6 +11,8 @@
 
 #include <sys/time.h>
 #include <signal.h>
+#include <time.h>
+#include <errno.h>
 
 SDL_Surface *real_screen;
 SDL_Surface *screen;
@@ -14,6 +20,14 @@ uint8_t (*pixel_buf) [SCREEN_COL];
 
 #define TIMER_HZ 100
 
+/* The timer is driven by ITIMER_VIRTUAL, so the guest clock only advances
+ * while NEMU is executing. By default an idle guest therefore skips straight
+ * to its next timer tick. With `idle_real_time', the host thread sleeps
+ * until the tick is due by the wall clock instead, which keeps the guest in
+ * step with real time.
+ */
+static struct timespec last_tick;
+
 static uint64_t jiffy = 0;
 static struct itimerval it;
 static int device_update_flag = false;
@@ -21,9 +35,15 @@ static int update_screen_flag = false;
 extern void timer_intr();
 extern void keyboard_intr();
 extern void update_screen();
+extern void ide_update();
+extern void i8042_update();
+extern void kbd_script_update();
+extern void pvcon_update();
+extern bool ide_idle();
 
 static void timer_sig_handler(int signum) {
 	jiffy ++;
+	clock_gettime(CLOCK_MONOTONIC, &last_tick);
 	timer_intr();
 
 	device_update_flag = true;
@@ -36,11 +56,17 @@ static void timer_sig_handler(int signum) {
 }
 
 void device_update() {
+	ide_update();
+	i8042_update();
+	kbd_script_update();
+
 	if(!device_update_flag) {
 		return;
 	}
 	device_update_flag = false;
 
+	pvcon_update();
+
 	if(update_screen_flag) {
 		update_screen();
 		update_screen_flag = false;
@@ -66,6 +92,38 @@ void device_update() {
 	}
 }
 
+/* Called when the CPU has nothing to do until the next device event,
+ * e.g. it executes `hlt' or spins on a device status port.
+ */
+void device_idle() {
+	/* A pending disk request is the nearest event. */
+	if(ide_idle()) {
+		return;
+	}
+
+	sigset_t set, oldset;
+	sigemptyset(&set);
+	sigaddset(&set, SIGVTALRM);
+	sigprocmask(SIG_BLOCK, &set, &oldset);
+
+	if(!device_update_flag) {
+		if(idle_real_time) {
+			struct timespec next = last_tick;
+			next.tv_nsec += 1000000000 / TIMER_HZ;
+			if(next.tv_nsec >= 1000000000) {
+				next.tv_sec ++;
+				next.tv_nsec -= 1000000000;
+			}
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+		}
+		/* fire the timer now, which also re-arms it */
+		timer_sig_handler(SIGVTALRM);
+	}
+
+	sigprocmask(SIG_SETMASK, &oldset, NULL);
+	device_update();
+}
+
 void sdl_clear_event_queue() {
 	SDL_Event event;
 	while(SDL_PollEvent(&event));
@@ -98,6 +156,7 @@ void init_sdl() {
 
 	it.it_value.tv_sec = 0;
 	it.it_value.tv_usec = 1000000 / TIMER_HZ;
+	clock_gettime(CLOCK_MONOTONIC, &last_tick);
 	ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
 	Assert(ret == 0, "Can not set timer");
 }
@@ -1,7 +1,11 @@
+#include "common.h"
+
 void init_monitor(int, char *[]);
 void reg_test();
 void restart();
 void ui_mainloop();
+bool has_perf_region();
+void print_perf_regions();
 
 int main(int argc, char *argv[]) {
 
@@ -17,5 +21,10 @@ int main(int argc, char *argv[]) {
 	/* Receive commands from user. */
 	ui_mainloop();
 
+	/* Report the regions measured by the program. */
+	if(has_perf_region()) {
+		print_perf_regions();
+	}
+
 	return 0;
 }
@@ -51,6 +51,21 @@ void init_ddr3() {
 	}
 }
 
+/* Devices which access the DRAM storage directly (e.g. DMA) should call
+ * this to drop the row buffers covering [addr, addr + len) after writing.
+ */
+void dram_invalidate(hwaddr_t addr, size_t len) {
+	hwaddr_t row_addr;
+	for(row_addr = addr & ~(NR_COL - 1); row_addr < addr + len; row_addr += NR_COL) {
+		dram_addr temp;
+		temp.addr = row_addr;
+		RB *rb = &rowbufs[temp.rank][temp.bank];
+		if(rb->valid && rb->row_idx == temp.row) {
+			rb->valid = false;
+		}
+	}
+}
+
 static void ddr3_read(hwaddr_t addr, void *data) {
 	Assert(addr < HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
 
@@ -1,10 +1,16 @@
-#include "common.h"
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "cpu/intr.h"
+#include "device/mmio.h"
 
 uint32_t dram_read(hwaddr_t, size_t);
 void dram_write(hwaddr_t, size_t, uint32_t);
 
 /* Memory accessing interfaces */
 
+uint64_t mem_read_count = 0, mem_write_count = 0;
+uint64_t tlb_miss_count = 0;
+
 uint32_t hwaddr_read(hwaddr_t addr, size_t len) {
 	return dram_read(addr, len) & (~0u >> ((4 - len) << 3));
 }
@@ -13,18 +19,153 @@ void hwaddr_write(hwaddr_t addr, size_t len, uint32_t data) {
 	dram_write(addr, len, data);
 }
 
+/* A direct-mapped TLB. Accessed and dirty bits in page tables are not maintained. */
+#define NR_TLB 64
+
+typedef struct {
+	bool valid;
+	bool writable;
+	bool large;		/* an entry of a 4MB page */
+	uint32_t vpn, ppn;
+} TLBEntry;
+
+static TLBEntry tlb[NR_TLB];
+
+/* Translations of 4MB pages are kept in a small TLB of their own, where
+ * `vpn' and `ppn' are numbers of 4MB pages. A 4MB page takes one entry there
+ * instead of up to 1024 entries in the TLB of 4KB pages.
+ */
+#define NR_LTLB 8
+
+static TLBEntry ltlb[NR_LTLB];
+
+void tlb_flush() {
+	int i;
+	for(i = 0; i < NR_TLB; i ++) {
+		tlb[i].valid = false;
+	}
+	for(i = 0; i < NR_LTLB; i ++) {
+		ltlb[i].valid = false;
+	}
+}
+
+/* Return the entry of the TLB of 4MB pages for `addr', or NULL if it misses. */
+static inline TLBEntry* ltlb_lookup(lnaddr_t addr) {
+	TLBEntry *l = &ltlb[(addr >> 22) % NR_LTLB];
+	return (l->valid && l->vpn == (addr >> 22) ? l : NULL);
+}
+
+/* error code of page faults */
+#define PF_PROT  0x1	/* 0: the page is not present, 1: protection violation */
+#define PF_WRITE 0x2
+
+static void page_fault(lnaddr_t addr, uint32_t error_code) {
+	Assert(nemu_state == RUNNING, "page fault at 0x%08x outside of execution", addr);
+	cpu.cr2 = addr;
+	raise_fault(14, error_code);
+}
+
+/* Walk the page tables for `addr', and put the translation into the TLB of
+ * its page size. Return the new entry.
+ */
+static TLBEntry* tlb_fill(lnaddr_t addr, bool is_write) {
+	PDE pde;
+	pde.val = hwaddr_read((cpu.cr3.page_directory_base << 12) + (addr >> 22) * 4, 4);
+	if(!pde.present) {
+		page_fault(addr, is_write ? PF_WRITE : 0);
+	}
+
+	if(pde.page_size && cpu.cr4.page_size_extension) {
+		/* a 4MB page, whose frame number takes the upper 10 bits */
+		TLBEntry *l = &ltlb[(addr >> 22) % NR_LTLB];
+		l->valid = true;
+		l->large = true;
+		l->vpn = addr >> 22;
+		l->ppn = pde.page_frame >> 10;
+		l->writable = pde.read_write;
+		return l;
+	}
+
+	PTE pte;
+	pte.val = hwaddr_read((pde.page_frame << 12) + ((addr >> 12) & 0x3ff) * 4, 4);
+	if(!pte.present) {
+		page_fault(addr, is_write ? PF_WRITE : 0);
+	}
+
+	TLBEntry *e = &tlb[(addr >> 12) % NR_TLB];
+	e->valid = true;
+	e->large = false;
+	e->vpn = addr >> 12;
+	e->ppn = pte.page_frame;
+	e->writable = pde.read_write && pte.read_write;
+	return e;
+}
+
+/* Translate `addr', which must be in the same page as the rest of the access. */
+static hwaddr_t page_translate(lnaddr_t addr, bool is_write) {
+	if(!cpu.cr0.paging) {
+		return addr;
+	}
+
+	TLBEntry *e = &tlb[(addr >> 12) % NR_TLB];
+	if(!e->valid || e->vpn != (addr >> 12)) {
+		e = ltlb_lookup(addr);
+		if(e == NULL) {
+			tlb_miss_count ++;
+			e = tlb_fill(addr, is_write);
+		}
+	}
+	if(is_write && !e->writable && cpu.cr0.write_protect) {
+		page_fault(addr, PF_PROT | PF_WRITE);
+	}
+	if(e->large) {
+		return (e->ppn << 22) | (addr & 0x3fffff);
+	}
+	return (e->ppn << 12) | (addr & PAGE_MASK);
+}
+
+/* the number of bytes of [addr, addr + len) in the page of `addr' */
+static inline size_t len_in_page(lnaddr_t addr, size_t len) {
+	size_t n = PAGE_SIZE - (addr & PAGE_MASK);
+	return (n < len ? n : len);
+}
+
 uint32_t lnaddr_read(lnaddr_t addr, size_t len) {
-	return hwaddr_read(addr, len);
+	size_t n = len_in_page(addr, len);
+	if(n < len) {
+		/* the data cross the page boundary */
+		uint32_t lo = lnaddr_read(addr, n);
+		uint32_t hi = lnaddr_read(addr + n, len - n);
+		return lo | (hi << (n << 3));
+	}
+	return hwaddr_read(page_translate(addr, false), len);
+}
+
+static inline void check_idt_write(lnaddr_t addr, size_t len) {
+	if(addr + len > cpu.idtr.base && addr <= cpu.idtr.base + cpu.idtr.limit) {
+		/* the decoded gate descriptors are out of date */
+		idt_invalidate();
+	}
 }
 
 void lnaddr_write(lnaddr_t addr, size_t len, uint32_t data) {
-	hwaddr_write(addr, len, data);
+	size_t n = len_in_page(addr, len);
+	if(n < len) {
+		/* the data cross the page boundary */
+		lnaddr_write(addr, n, data);
+		lnaddr_write(addr + n, len - n, data >> (n << 3));
+		return;
+	}
+	hwaddr_t hwaddr = page_translate(addr, true);
+	check_idt_write(addr, len);
+	hwaddr_write(hwaddr, len, data);
 }
 
 uint32_t swaddr_read(swaddr_t addr, size_t len) {
 #ifdef DEBUG
 	assert(len == 1 || len == 2 || len == 4);
 #endif
+	mem_read_count ++;
 	return lnaddr_read(addr, len);
 }
 
@@ -32,6 +173,68 @@ void swaddr_write(swaddr_t addr, size_t len, uint32_t data) {
 #ifdef DEBUG
 	assert(len == 1 || len == 2 || len == 4);
 #endif
+	mem_write_count ++;
 	lnaddr_write(addr, len, data);
 }
 
+
+/* Return the address in NEMU of the guest data [addr, addr + len), which
+ * must not cross a page boundary, or NULL if the data is not plain memory
+ * (e.g. MMIO). If `is_write' is set, the caller is going to modify the data
+ * directly, so anything caching it is dropped. Like other accesses, it
+ * raises a page fault if the page is not accessible.
+ */
+void* swaddr_host_ptr(swaddr_t addr, size_t len, bool is_write) {
+	assert(len > 0 && (addr & ~PAGE_MASK) == ((addr + len - 1) & ~PAGE_MASK));
+	lnaddr_t lnaddr = addr;
+	hwaddr_t hwaddr = page_translate(lnaddr, is_write);
+	if(hwaddr >= HW_MEM_SIZE || len > HW_MEM_SIZE - hwaddr) {
+		return NULL;
+	}
+#ifdef HAS_DEVICE
+	if(is_mmio(hwaddr) != -1 || is_mmio(hwaddr + len - 1) != -1) {
+		return NULL;
+	}
+#endif
+
+	if(is_write) {
+		check_idt_write(lnaddr, len);
+		dram_invalidate(hwaddr, len);
+	}
+	return hwa_to_va(hwaddr);
+}
+
+/* Copy between the guest and NEMU page by page. Pages which are not plain
+ * memory are accessed byte by byte.
+ */
+void swaddr_read_buf(swaddr_t addr, void *buf, size_t len) {
+	uint8_t *p = buf;
+	while(len > 0) {
+		size_t i, n = PAGE_SIZE - (addr & PAGE_MASK);
+		if(n > len) { n = len; }
+		void *src = swaddr_host_ptr(addr, n, false);
+		if(src) { memcpy(p, src, n); }
+		else {
+			for(i = 0; i < n; i ++) { p[i] = swaddr_read(addr + i, 1); }
+		}
+		p += n;
+		addr += n;
+		len -= n;
+	}
+}
+
+void swaddr_write_buf(swaddr_t addr, const void *buf, size_t len) {
+	const uint8_t *p = buf;
+	while(len > 0) {
+		size_t i, n = PAGE_SIZE - (addr & PAGE_MASK);
+		if(n > len) { n = len; }
+		void *dst = swaddr_host_ptr(addr, n, true);
+		if(dst) { memcpy(dst, p, n); }
+		else {
+			for(i = 0; i < n; i ++) { swaddr_write(addr + i, 1, p[i]); }
+		}
+		p += n;
+		addr += n;
+		len -= n;
+	}
+}
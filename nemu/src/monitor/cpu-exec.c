@@ -2,6 +2,8 @@
 #include "cpu/helper.h"
 #include "monitor/watchpoint.h"
 #include "monitor/expr.h"
+#include "cpu/intr.h"
+#include "cpu/native.h"
 #include <setjmp.h>
 
 /* The assembly code of instructions executed is only output to the screen
@@ -13,6 +15,9 @@
 
 int nemu_state = STOP;
 
+uint64_t instr_count = 0;
+uint64_t branch_count = 0;
+
 int exec(swaddr_t);
 
 char assembly[80];
@@ -20,6 +25,8 @@ char asm_buf[128];
 
 /* Used with exception handling. */
 jmp_buf jbuf;
+swaddr_t instr_eip;
+uint32_t instr_esp;
 
 void print_bin_instr(swaddr_t eip, int len) {
   int i;
@@ -61,9 +68,13 @@ void cpu_exec(volatile uint32_t n) {
 
     /* Execute one instruction, including instruction fetch,
      * instruction decode, and the actual execution. */
-    int instr_len = exec(cpu.eip);
+    instr_eip = cpu.eip;
+    instr_esp = cpu.esp;
+    int instr_len = (is_native_entry(cpu.eip) ? native_call(cpu.eip) : exec(cpu.eip));
 
     cpu.eip += instr_len;
+    instr_count ++;
+    if (cpu.eip != instr_eip + instr_len) { branch_count ++; }
 
 #ifdef DEBUG
     print_bin_instr(eip_temp, instr_len);
@@ -92,6 +103,16 @@ void cpu_exec(volatile uint32_t n) {
 #ifdef HAS_DEVICE
     extern void device_update();
     device_update();
+
+    /* cpu.INTR is only set while the i8259 has a pending request,
+     * so this costs a single test when there is no interrupt. */
+    if (cpu.INTR & cpu.eflags.IF) {
+      uint8_t i8259_query_intr();
+      void i8259_ack_intr();
+      uint8_t NO = i8259_query_intr();
+      i8259_ack_intr();
+      enter_intr(NO);
+    }
 #endif
 
   }
@@ -10,7 +10,7 @@ static int nr_symtab_entry;
 
 void load_elf_tables(int argc, char *argv[]) {
 	int ret;
-	Assert(argc == 2, "run NEMU with format 'nemu [program]'");
+	Assert(argc == 2, "run NEMU with format 'nemu [OPTION...] [program]'");
 	exec_file = argv[1];
 
 	FILE *fp = fopen(exec_file, "rb");
@@ -81,3 +81,14 @@ void load_elf_tables(int argc, char *argv[]) {
 	fclose(fp);
 }
 
+
+/* Return the address of the function `name' in the program, or 0 if there is no such function. */
+swaddr_t find_func_symbol(const char *name) {
+	int i;
+	for(i = 0; i < nr_symtab_entry; i ++) {
+		if(ELF32_ST_TYPE(symtab[i].st_info) == STT_FUNC && strcmp(strtab + symtab[i].st_name, name) == 0) {
+			return symtab[i].st_value;
+		}
+	}
+	return 0;
+}
@@ -11,6 +11,7 @@
 
 
 void cpu_exec(uint32_t);
+void print_perf_regions();
 
 /* We use the ``readline'' library to provide more flexibility to read from stdin. */
 char* rl_gets() {
@@ -115,13 +116,15 @@ static int cmd_info(char *args) {
 			print_regs();
 		} else if (strcmp(token,"w") == 0) {
 			print_watch_points();
+		} else if (strcmp(token,"perf") == 0) {
+			print_perf_regions();
 		}
 
 		if ((token = strtok(NULL, DEFAULT_DELIM)) != NULL) {
 			printf("Undefined info command: %s.\n", token);
 		}
 	} else {
-		printf("usage: info [r|w]\n");
+		printf("usage: info [r|w|perf]\n");
 	}
 
 	return 0;
@@ -0,0 +1,138 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "cpu/native.h"
+#include "cpu/intr.h"
+
+#include <time.h>
+
+/* Hypercalls, issued by the `nemu_trap' instruction (opcode 0xd6).
+ * The number of the call is in %eax, and the arguments are in %ebx, %ecx,
+ * %edx and %esi. The result is returned in %eax (and %edx for 64-bit
+ * results), other registers are left untouched. Addresses are virtual
+ * addresses of the guest. See lib-common/trap.h for the wrappers.
+ *
+ *   no  name            arguments                  result
+ *   0   good trap       -                          (stop NEMU)
+ *   1   bad trap        -                          (stop NEMU)
+ *   2   nop             -                          -
+ *   3   memcpy          dst, src, len              dst
+ *   4   memset          dst, c, len                dst
+ *   5   file read       path, buf, len, offset     bytes read, or -1
+ *   6   monotonic time  -                          microseconds (%edx:%eax)
+ *   7   perf marker     id                         -
+ *   8   perf begin      id                         -
+ *   9   perf end        id                         -
+ *   10  trap vector     vector, limit              -
+ */
+
+#define NR_HYPERCALL_PATH 256
+
+/* Good and bad traps at eip below `trap_limit' are delivered as interrupt
+ * `trap_vector' if it is not negative, see hc_trap_vector().
+ */
+static int trap_vector;
+static uint32_t trap_limit;
+
+static void hc_trap() {
+	if(trap_vector >= 0 && cpu.eip < trap_limit) {
+		/* the handler returns to the next instruction */
+		cpu.eip += 1;
+		raise_intr(trap_vector);
+	}
+
+	printf("\33[1;31mnemu: HIT %s TRAP\33[0m at eip = 0x%08x\n\n",
+			(cpu.eax == 0 ? "GOOD" : "BAD"), cpu.eip);
+	nemu_state = END;
+}
+
+static void hc_nop() {
+}
+
+static void hc_memcpy() {
+	cpu.eax = native_memmove(cpu.ebx, cpu.ecx, cpu.edx);
+}
+
+static void hc_memset() {
+	cpu.eax = native_memset(cpu.ebx, cpu.ecx, cpu.edx);
+}
+
+static void hc_file_read() {
+	char path[NR_HYPERCALL_PATH];
+	uint32_t len = native_strlen(cpu.ebx, 0, 0);
+	if(len >= NR_HYPERCALL_PATH) {
+		cpu.eax = -1;
+		return;
+	}
+	swaddr_read_buf(cpu.ebx, path, len + 1);
+
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL || fseek(fp, cpu.esi, SEEK_SET) != 0) {
+		if(fp) { fclose(fp); }
+		cpu.eax = -1;
+		return;
+	}
+
+	/* read through a bounce buffer, since the guest buffer may not be contiguous */
+	uint8_t buf[PAGE_SIZE];
+	uint32_t total = 0;
+	while(total < cpu.edx) {
+		size_t n = cpu.edx - total;
+		if(n > PAGE_SIZE) { n = PAGE_SIZE; }
+		n = fread(buf, 1, n, fp);
+		if(n == 0) { break; }
+		swaddr_write_buf(cpu.ecx + total, buf, n);
+		total += n;
+	}
+	fclose(fp);
+	cpu.eax = total;
+}
+
+static void hc_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	uint64_t us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	cpu.eax = (uint32_t)us;
+	cpu.edx = (uint32_t)(us >> 32);
+}
+
+static void hc_perf_mark() {
+	printf("nemu: perf marker %d at eip = 0x%08x, %llu instructions\n",
+			cpu.ebx, cpu.eip, (unsigned long long)instr_count);
+}
+
+void perf_begin(uint32_t);
+void perf_end(uint32_t);
+
+static void hc_perf_begin() {
+	perf_begin(cpu.ebx);
+}
+
+static void hc_perf_end() {
+	perf_end(cpu.ebx);
+}
+
+static void hc_trap_vector() {
+	trap_vector = cpu.ebx;
+	trap_limit = cpu.ecx;
+}
+
+static void (*hypercall_table[])() = {
+	hc_trap, hc_trap, hc_nop, hc_memcpy,
+	hc_memset, hc_file_read, hc_time, hc_perf_mark,
+	hc_perf_begin, hc_perf_end, hc_trap_vector,
+};
+
+#define NR_HYPERCALL (sizeof(hypercall_table) / sizeof(hypercall_table[0]))
+
+void do_hypercall() {
+	if(cpu.eax >= NR_HYPERCALL) {
+		printf("\33[1;31mnemu: unknown hypercall %d\33[0m at eip = 0x%08x\n\n", cpu.eax, cpu.eip);
+		nemu_state = END;
+		return;
+	}
+	hypercall_table[cpu.eax]();
+}
+
+void init_hypercall() {
+	trap_vector = -1;
+}
@@ -0,0 +1,63 @@
+#include "nemu.h"
+
+#include <stdlib.h>
+#include <elf.h>
+
+/* A kernel linked above this address (e.g. 0xc0100000) is loaded at its
+ * physical address (e.g. 0x100000), since paging is not enabled at boot. */
+#define KOFFSET 0xc0000000
+
+/* Load the PT_LOAD segments of the ELF executable `filename' into guest
+ * physical memory and zero their BSS parts. Return the entry point. If
+ * `end' is not NULL, the end address of the highest segment is stored
+ * into it.
+ */
+uint32_t load_elf_segments(const char *filename, uint32_t *end) {
+	int ret;
+	FILE *fp = fopen(filename, "rb");
+	Assert(fp, "Can not open '%s'", filename);
+
+	Elf32_Ehdr elf;
+	ret = fread(&elf, sizeof(elf), 1, fp);
+	assert(ret == 1);
+	Assert(memcmp(elf.e_ident, ELFMAG, SELFMAG) == 0 && elf.e_ident[EI_CLASS] == ELFCLASS32
+			&& elf.e_machine == EM_386 && elf.e_type == ET_EXEC,
+			"'%s' is not an i386 executable", filename);
+
+	uint32_t ph_size = elf.e_phentsize * elf.e_phnum;
+	Elf32_Phdr *ph = malloc(ph_size);
+	fseek(fp, elf.e_phoff, SEEK_SET);
+	ret = fread(ph, ph_size, 1, fp);
+	assert(ret == 1);
+
+	uint32_t max_end = 0;
+	int i;
+	for(i = 0; i < elf.e_phnum; i ++) {
+		if(ph[i].p_type != PT_LOAD) {
+			continue;
+		}
+
+		hwaddr_t addr = ph[i].p_vaddr;
+		if(addr >= KOFFSET) { addr -= KOFFSET; }
+		Assert(addr < HW_MEM_SIZE && ph[i].p_memsz <= HW_MEM_SIZE - addr,
+				"segment [0x%08x, 0x%08x) of '%s' is out of physical memory",
+				addr, addr + ph[i].p_memsz, filename);
+
+		fseek(fp, ph[i].p_offset, SEEK_SET);
+		ret = fread(hwa_to_va(addr), ph[i].p_filesz, 1, fp);
+		assert(ph[i].p_filesz == 0 || ret == 1);
+		memset(hwa_to_va(addr + ph[i].p_filesz), 0, ph[i].p_memsz - ph[i].p_filesz);
+
+		if(addr + ph[i].p_memsz > max_end) {
+			max_end = addr + ph[i].p_memsz;
+		}
+	}
+
+	free(ph);
+	fclose(fp);
+
+	if(end != NULL) {
+		*end = max_end;
+	}
+	return (elf.e_entry >= KOFFSET ? elf.e_entry - KOFFSET : elf.e_entry);
+}
@@ -1,15 +1,34 @@
 #include "nemu.h"
 
-#define ENTRY_START 0x100000
+#include <stdlib.h>
+#include <unistd.h>
+
+/* The program is put here for the kernel to load, see kernel/src/driver/ramdisk.c.
+ * It may take up all physical memory above, and the kernel does not allocate
+ * the pages that a program larger than 8MB covers above 16MB. */
+#define RAMDISK_START 0x800000
+#define RAMDISK_MAX_SIZE (HW_MEM_SIZE - RAMDISK_START)
 
-extern uint8_t entry [];
-extern uint32_t entry_len;
 extern char *exec_file;
+extern char *overlay_file;
+extern bool overlay_commit;
+extern char *kbd_script_file;
+extern char *console_input_file;
+extern bool user_mode;
+extern char *native_list;
+extern bool idle_real_time;
 
 void load_elf_tables(int, char *[]);
 void init_regex();
 void init_wp_pool();
 void init_ddr3();
+void init_user();
+void init_native();
+void init_hypercall();
+uint32_t load_elf_segments(const char *, uint32_t *);
+
+/* the kernel to boot, set by the `-K' option */
+static char *kernel_file = NULL;
 
 FILE *log_fp = NULL;
 
@@ -18,6 +37,45 @@ static void init_log() {
 	Assert(log_fp, "Can not open 'log.txt'");
 }
 
+static void usage(const char *name) {
+	printf("Usage: %s [OPTION...] program\n\n", name);
+	printf("  -K FILE    boot the kernel ELF FILE, which loads the program\n");
+	printf("  -o FILE    keep guest disk writes in the copy-on-write overlay FILE,\n"
+	       "             leaving the program image untouched\n");
+	printf("  -C         commit the overlay into the program image at exit\n");
+	printf("  -k FILE    feed the keyboard with the timestamped events in FILE\n");
+	printf("  -i FILE    feed the paravirtual console with the content of FILE\n");
+	printf("  -r         sleep until the next timer tick when the guest is idle,\n"
+	       "             instead of skipping to it\n");
+	printf("  -u         user mode: load the program without the kernel, and serve\n"
+	       "             its system calls on the host\n");
+	printf("  -n LIST    perform the C library functions in LIST (comma-separated,\n"
+	       "             or `all') natively: memcpy, memmove, memset, strlen, strcmp\n");
+	exit(1);
+}
+
+/* Parse the command line options, and return the index of the program name. */
+static int parse_args(int argc, char *argv[]) {
+	int c;
+	while((c = getopt(argc, argv, "+K:o:Ck:i:run:")) != -1) {
+		switch(c) {
+			case 'K': kernel_file = optarg; break;
+			case 'o': overlay_file = optarg; break;
+			case 'C': overlay_commit = true; break;
+			case 'k': kbd_script_file = optarg; break;
+			case 'i': console_input_file = optarg; break;
+			case 'r': idle_real_time = true; break;
+			case 'u': user_mode = true; break;
+			case 'n': native_list = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if(overlay_commit && overlay_file == NULL) { usage(argv[0]); }
+	if(user_mode && kernel_file != NULL) { usage(argv[0]); }
+	return optind;
+}
+
 static void welcome() {
 	printf("Welcome to NEMU!\nThe executable is %s.\nFor help, type \"help\"\n",
 			exec_file);
@@ -29,8 +87,11 @@ void init_monitor(int argc, char *argv[]) {
 	/* Open the log file. */
 	init_log();
 
+	/* Parse the command line options. */
+	int idx = parse_args(argc, argv);
+
 	/* Load the string table and symbol table from the ELF file for future use. */
-	load_elf_tables(argc, argv);
+	load_elf_tables(argc - idx + 1, argv + idx - 1);
 
 	/* Compile the regular expressions. */
 	init_regex();
@@ -45,48 +106,63 @@ void init_monitor(int argc, char *argv[]) {
 #ifdef USE_RAMDISK
 static void init_ramdisk() {
 	int ret;
-	const int ramdisk_max_size = 0xa0000;
 	FILE *fp = fopen(exec_file, "rb");
 	Assert(fp, "Can not open '%s'", exec_file);
 
 	fseek(fp, 0, SEEK_END);
 	size_t file_size = ftell(fp);
-	Assert(file_size < ramdisk_max_size, "file size(%zd) too large", file_size);
+	Assert(file_size <= RAMDISK_MAX_SIZE, "file size(%zd) too large", file_size);
 
 	fseek(fp, 0, SEEK_SET);
-	ret = fread(hwa_to_va(0), file_size, 1, fp);
+	ret = fread(hwa_to_va(RAMDISK_START), file_size, 1, fp);
 	assert(ret == 1);
 	fclose(fp);
 }
 #endif
 
-static void load_entry() {
-	int ret;
-	FILE *fp = fopen("entry", "rb");
-	Assert(fp, "Can not open 'entry'");
-
-	fseek(fp, 0, SEEK_END);
-	size_t file_size = ftell(fp);
-
-	fseek(fp, 0, SEEK_SET);
-	ret = fread(hwa_to_va(ENTRY_START), file_size, 1, fp);
-	assert(ret == 1);
-	fclose(fp);
-}
-
 void restart() {
 	/* Perform some initialization to restart a program */
+	if(user_mode) {
+		/* Load the program directly, and set up its stack. */
+		init_user();
+	}
+	else if(kernel_file) {
 #ifdef USE_RAMDISK
-	/* Read the file with name `argv[1]' into ramdisk. */
-	init_ramdisk();
+		/* Read the file with name `argv[1]' into ramdisk. */
+		init_ramdisk();
 #endif
 
-	/* Read the entry code into memory. */
-	load_entry();
+		/* Load the kernel, and start from its entry. */
+		cpu.eip = load_elf_segments(kernel_file, NULL);
+	}
+	else {
+		/* Run the program on the bare machine. */
+		cpu.eip = load_elf_segments(exec_file, NULL);
+	}
 
-	/* Set the initial instruction pointer. */
-	cpu.eip = ENTRY_START;
+	/* Set the initial value of EFLAGS, where bit 1 is always set. */
+	cpu.eflags.val = 0x2;
+
+	/* the code segment selector used by the kernel */
+	cpu.cs = 0x8;
+	cpu.idtr.base = 0;
+	cpu.idtr.limit = 0;
+
+	/* Start without paging. */
+	cpu.cr0.val = 0;
+	cpu.cr3.val = 0;
+	cpu.cr4.val = 0;
+	tlb_flush();
+
+	/* `sysenter' faults until the MSRs are set */
+	cpu.sysenter_cs = 0;
 
 	/* Initialize DRAM. */
 	init_ddr3();
+
+	/* Find the library functions to perform natively. */
+	init_native();
+
+	/* Traps stop NEMU until the kernel asks for them. */
+	init_hypercall();
 }
@@ -0,0 +1,91 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+
+/* Regions of the guest bracketed by PERF_BEGIN(id) and PERF_END(id) in
+ * lib-common/trap.h. The cost of a region is measured in instructions,
+ * which is also the virtual time, so the result is free of sampling noise.
+ * Nested entries into a region with the same id are counted as part of the
+ * outermost one.
+ */
+
+#define NR_PERF_REGION 64
+
+typedef struct {
+	int depth;
+	uint64_t begin_instr, begin_mem;
+
+	uint64_t nr_entry;
+	uint64_t total, min, max;
+	uint64_t nr_mem;
+} PerfRegion;
+
+static PerfRegion regions[NR_PERF_REGION];
+
+static PerfRegion* get_region(uint32_t id) {
+	if(id >= NR_PERF_REGION) {
+		Log("perf region %d is out of range [0, %d)", id, NR_PERF_REGION);
+		return NULL;
+	}
+	return &regions[id];
+}
+
+static inline uint64_t mem_count() {
+	return mem_read_count + mem_write_count;
+}
+
+void perf_begin(uint32_t id) {
+	PerfRegion *r = get_region(id);
+	if(r && r->depth ++ == 0) {
+		r->begin_instr = instr_count;
+		r->begin_mem = mem_count();
+	}
+}
+
+void perf_end(uint32_t id) {
+	PerfRegion *r = get_region(id);
+	if(r == NULL) {
+		return;
+	}
+	if(r->depth == 0) {
+		Log("PERF_END(%d) without PERF_BEGIN at eip = 0x%08x", id, cpu.eip);
+		return;
+	}
+	if(-- r->depth > 0) {
+		return;
+	}
+
+	/* do not count the trap instruction of PERF_BEGIN */
+	uint64_t len = instr_count - r->begin_instr - 1;
+	if(r->nr_entry == 0 || len < r->min) { r->min = len; }
+	if(r->nr_entry == 0 || len > r->max) { r->max = len; }
+	r->total += len;
+	r->nr_entry ++;
+	r->nr_mem += mem_count() - r->begin_mem;
+}
+
+bool has_perf_region() {
+	int i;
+	for(i = 0; i < NR_PERF_REGION; i ++) {
+		if(regions[i].nr_entry > 0) { return true; }
+	}
+	return false;
+}
+
+void print_perf_regions() {
+	if(!has_perf_region()) {
+		printf("No perf regions.\n");
+		return;
+	}
+
+	printf("%4s %10s %14s %12s %12s %12s %14s\n",
+			"id", "entries", "instructions", "min", "max", "avg", "mem accesses");
+	int i;
+	for(i = 0; i < NR_PERF_REGION; i ++) {
+		PerfRegion *r = &regions[i];
+		if(r->nr_entry == 0) { continue; }
+		printf("%4d %10llu %14llu %12llu %12llu %12llu %14llu\n", i,
+				(unsigned long long)r->nr_entry, (unsigned long long)r->total,
+				(unsigned long long)r->min, (unsigned long long)r->max,
+				(unsigned long long)(r->total / r->nr_entry), (unsigned long long)r->nr_mem);
+	}
+}
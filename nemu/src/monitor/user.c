@@ -0,0 +1,129 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* User mode, set by the `-u' option. The program is loaded by NEMU
+ * without the kernel, and its system calls (`int $0x80') are served by
+ * the host directly. Guest file descriptors are host file descriptors.
+ */
+bool user_mode = false;
+
+#define USER_STACK_TOP HW_MEM_SIZE
+#define USER_STACK_SIZE (1 << 20)
+
+/* system call numbers of i386 GNU/Linux */
+#define NR_exit       1
+#define NR_read       3
+#define NR_write      4
+#define NR_open       5
+#define NR_close      6
+#define NR_lseek      19
+#define NR_brk        45
+#define NR_exit_group 252
+
+extern char *exec_file;
+uint32_t load_elf_segments(const char *, uint32_t *);
+
+static uint32_t program_break;
+
+void init_user() {
+	uint32_t end;
+	cpu.eip = load_elf_segments(exec_file, &end);
+	program_break = end;
+
+	/* argc, argv and envp are all zero */
+	cpu.esp = USER_STACK_TOP - 16;
+	memset(hwa_to_va(cpu.esp), 0, 16);
+}
+
+/* the buffer [addr, addr + len) in the guest */
+static void* user_buf(uint32_t addr, uint32_t len) {
+	Assert(addr < HW_MEM_SIZE && len <= HW_MEM_SIZE - addr,
+			"user buffer [0x%08x, 0x%08x) is out of bound", addr, addr + len);
+	return hwa_to_va(addr);
+}
+
+static const char* user_str(uint32_t addr) {
+	const char *s = user_buf(addr, 1);
+	Assert(memchr(s, '\0', HW_MEM_SIZE - addr) != NULL, "user string at 0x%08x is not terminated", addr);
+	return s;
+}
+
+static inline uint32_t host_ret(long ret) {
+	return (ret < 0 ? -errno : ret);
+}
+
+static void sys_exit(int status) {
+	printf("\33[1;31mnemu: program exited with status %d\33[0m at eip = 0x%08x\n\n", status, cpu.eip);
+	nemu_state = END;
+}
+
+static uint32_t sys_brk(uint32_t addr) {
+	/* the same convention as the kernel: 0 for success */
+	if(addr < program_break || addr > USER_STACK_TOP - USER_STACK_SIZE) {
+		return -1;
+	}
+	program_break = addr;
+	return 0;
+}
+
+static uint32_t sys_read(int fd, uint32_t buf, uint32_t len) {
+	long ret = read(fd, user_buf(buf, len), len);
+	if(ret > 0) {
+		dram_invalidate(buf, ret);
+	}
+	return host_ret(ret);
+}
+
+/* The flags of open() in the newlib of the guest, see
+ * lib-common/newlib/include/sys/_default_fcntl.h. They differ from the ones
+ * of the host.
+ */
+#define GUEST_O_ACCMODE  0x0003
+#define GUEST_O_APPEND   0x0008
+#define GUEST_O_CREAT    0x0200
+#define GUEST_O_TRUNC    0x0400
+#define GUEST_O_EXCL     0x0800
+#define GUEST_O_SYNC     0x2000
+#define GUEST_O_NONBLOCK 0x4000
+#define GUEST_O_NOCTTY   0x8000
+
+static uint32_t sys_open(uint32_t path, uint32_t guest_flags, uint32_t mode) {
+	static const struct { uint32_t guest; int host; } flag_map[] = {
+		{ GUEST_O_APPEND, O_APPEND }, { GUEST_O_CREAT, O_CREAT },
+		{ GUEST_O_TRUNC, O_TRUNC }, { GUEST_O_EXCL, O_EXCL },
+		{ GUEST_O_SYNC, O_SYNC }, { GUEST_O_NONBLOCK, O_NONBLOCK },
+		{ GUEST_O_NOCTTY, O_NOCTTY },
+	};
+
+	/* O_RDONLY, O_WRONLY and O_RDWR are the same */
+	int flags = guest_flags & GUEST_O_ACCMODE;
+	int i;
+	for(i = 0; i < sizeof(flag_map) / sizeof(flag_map[0]); i ++) {
+		if(guest_flags & flag_map[i].guest) {
+			flags |= flag_map[i].host;
+		}
+	}
+	return host_ret(open(user_str(path), flags, mode));
+}
+
+void do_user_syscall() {
+	uint32_t ebx = cpu.ebx, ecx = cpu.ecx, edx = cpu.edx;
+	switch(cpu.eax) {
+		case NR_exit:
+		case NR_exit_group: sys_exit(ebx); break;
+		case NR_brk: cpu.eax = sys_brk(ebx); break;
+		case NR_read: cpu.eax = sys_read(ebx, ecx, edx); break;
+		case NR_write: cpu.eax = host_ret(write(ebx, user_buf(ecx, edx), edx)); break;
+		case NR_open: cpu.eax = sys_open(ebx, ecx, edx); break;
+		case NR_close:
+			/* do not close the standard streams of NEMU */
+			cpu.eax = (ebx <= 2 ? 0 : host_ret(close(ebx)));
+			break;
+		case NR_lseek: cpu.eax = host_ret(lseek(ebx, (int32_t)ecx, edx)); break;
+		default: panic("Unhandled system call: id = %d", cpu.eax);
+	}
+}